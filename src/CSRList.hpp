@@ -3,10 +3,13 @@
 
 #include "CSRListIterator.hpp"
 #include "CSRListObject.hpp"
+#include "CSRListView.hpp"
+#include <algorithm>
 #include <type_traits>
 #include <vector>
 
 #include "GraphConverter.hpp"
+#include "Parallel.hpp"
 
 // template <typename T, typename U = T, typename directed_category> struct
 // CSRList {};
@@ -24,7 +27,12 @@ template<typename List> inline constexpr bool is_CSRList_v =
 is_CSRList<List>::value;
 */
 
-template <typename T, typename U = T,
+/*
+ * Rows of T stored contiguously. Row i spans [offset[i], offset[i + 1]) of
+ * the data; the offsets are std::size_t by default so that a list with
+ * 32-bit entries may still hold more than 2^32 of them.
+ */
+template <typename T, typename U = std::size_t,
           typename DirectedCategory = std::true_type>
 struct CSRList {
     using data_type = T;
@@ -32,6 +40,7 @@ struct CSRList {
     using directed_category = DirectedCategory;
     using const_iterator =
         CSRListIterator<const CSRList<T, U, DirectedCategory>>;
+    using row_type = CSRListView<T>;
 
     CSRList() : _data(0), _offset(1, 0) {}
 
@@ -75,9 +84,10 @@ struct CSRList {
         return {_offset.at(index), _offset.at(index + 1)};
     }
 
-    std::vector<data_type> data(size_t index) const {
-        return std::vector<data_type>(_data.begin() + _offset.at(index),
-                                      _data.begin() + _offset.at(index + 1));
+    row_type data(size_t index) const {
+        auto begin = _offset.at(index);
+        auto end = _offset.at(index + 1);
+        return row_type(_data.data() + begin, end - begin);
     }
 
     const std::vector<data_type> &data() const noexcept { return _data; }
@@ -88,9 +98,7 @@ struct CSRList {
 
     std::vector<size_type> &offset() noexcept { return _offset; }
 
-    std::vector<data_type> operator[](size_t index) const {
-        return data(index);
-    }
+    row_type operator[](size_t index) const { return data(index); }
 
     template <typename Other>
     std::common_type_t<T, Other> push_back(const std::vector<Other> &entity) {
@@ -99,6 +107,13 @@ struct CSRList {
         return {};
     }
 
+    template <typename Other>
+    std::common_type_t<T, Other> push_back(const CSRListView<Other> &entity) {
+        data().insert(data().end(), entity.begin(), entity.end());
+        offset().push_back(data().size());
+        return {};
+    }
+
     template <typename Other>
     std::common_type_t<T, Other> push_back(std::vector<T> &&entity) {
         if (data().empty()) {
@@ -135,41 +150,61 @@ struct CSRList {
 
     const_iterator end() const { return iterator(num_entities()); }
 
+    /**
+     * @brief transpose the list: row j of the result holds, in ascending
+     * order, the indices of the rows that contain j.
+     * Counting sort: per-thread histograms of the targets, an exclusive scan
+     * into the result offsets, then a scatter straight into the result data.
+     * Every thread owns a contiguous block of rows and its own write cursor
+     * per target, so the output is identical for any num_threads.
+     */
     template <typename Data = T>
-    std::enable_if_t<std::is_same_v<Data, U> and std::is_integral_v<Data>,
-                     CSRList>
-    reverse() const {
-        // TODO: find an inplace reversing method
-        // std::map<T, std::vector<T>> graph_tmp;
-        auto vector_length =
-            1 + *std::max_element(this->data().begin(), this->data().end());
-        std::vector<std::vector<T>> graph_tmp(vector_length);
-        std::size_t expected_bandwidth = 32;
-        for (auto &cache : graph_tmp) {
-            cache.reserve(expected_bandwidth);
+    std::enable_if_t<std::is_integral_v<Data>, CSRList>
+    reverse(std::size_t num_threads = 1) const {
+        CSRList results;
+        if (_data.empty()) {
+            return results;
         }
-        for (auto it = this->begin(); it != this->end(); ++it) {
-            for (auto index : it->data()) {
-                // graph_tmp[index].insert(it->index());
-                graph_tmp[index].push_back(it->index());
+        const std::size_t num_rows = num_entities();
+        const std::size_t num_targets =
+            1 + *std::max_element(_data.begin(), _data.end());
+
+        std::vector<std::vector<U>> cursor(
+            std::max<std::size_t>(1, std::min(num_threads, num_rows)));
+        num_threads = parallel::for_each_chunk(
+            num_rows, num_threads,
+            [&](std::size_t begin, std::size_t end, std::size_t t) {
+                auto &histogram = cursor[t];
+                histogram.assign(num_targets, 0);
+                for (auto k = _offset[begin]; k < _offset[end]; ++k) {
+                    ++histogram[_data[k]];
+                }
+            });
+
+        auto &offset = results.offset();
+        offset.assign(num_targets + 1, 0);
+        for (std::size_t j = 0; j < num_targets; ++j) {
+            U position = offset[j];
+            for (std::size_t t = 0; t < num_threads; ++t) {
+                auto count = cursor[t][j];
+                cursor[t][j] = position;
+                position += count;
             }
+            offset[j + 1] = position;
         }
 
-        CSRList results;
-        auto max_index =
-            (graph_tmp.size()
-                 ? graph_tmp.size() - 1
-                 : 0); // an ordered map stores the largest index in the end
-        for (Data i = 0; i <= max_index and max_index != 0; ++i) {
-            const auto it = graph_tmp.begin() + i;
-            if (it != graph_tmp.end() and it->size() > 0) {
-                // auto v = std::vector<Data>(it->second.begin(),
-                // it->second.end());
-                results.push_back(*it);
-            } else {
-                results.push_back(std::vector<Data>({}));
-            }
-        }
+        auto &data = results.data();
+        data.resize(_data.size());
+        parallel::for_each_chunk(
+            num_rows, num_threads,
+            [&](std::size_t begin, std::size_t end, std::size_t t) {
+                auto &position = cursor[t];
+                for (auto i = begin; i < end; ++i) {
+                    for (auto k = _offset[i]; k < _offset[i + 1]; ++k) {
+                        data[position[_data[k]]++] = static_cast<Data>(i);
+                    }
+                }
+            });
         return results;
     }
 
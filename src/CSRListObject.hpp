@@ -1,7 +1,7 @@
 #ifndef __CSRLIST_OBJECT_H__
 #define __CSRLIST_OBJECT_H__
 
-#include <vector>
+#include "CSRListView.hpp"
 
 template <typename List> struct CSRListObject {
     using data_type = typename List::data_type;
@@ -11,15 +11,10 @@ template <typename List> struct CSRListObject {
         : _plist(&list), _index(index) {}
 
     std::pair<size_type, size_type> range() const {
-        return {_plist->_offset.at(_index), _plist->_offset.at(_index + 1)};
+        return {_plist->offset().at(_index), _plist->offset().at(_index + 1)};
     }
 
-    std::vector<data_type> data() const {
-        const auto it0 = _plist->data().begin() + _plist->offset().at(_index);
-        const auto it1 =
-            _plist->data().begin() + _plist->offset().at(_index + 1);
-        return std::vector<data_type>(it0, it1);
-    }
+    CSRListView<data_type> data() const { return _plist->data(_index); }
 
     size_type index() const { return _index; }
 
@@ -30,8 +25,8 @@ template <typename List> struct CSRListObject {
 
     data_type operator[](size_type i) const {
         assert(i < size());
-        auto shift = _plist->_offset.at(_index);
-        return _plist->_data[i + shift];
+        auto shift = _plist->offset().at(_index);
+        return _plist->data()[i + shift];
     }
 
 private:
@@ -0,0 +1,53 @@
+#ifndef __CSRLIST_VIEW_H__
+#define __CSRLIST_VIEW_H__
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+/*
+ * Non-owning view of a single row of a CSRList: a pointer into the list's
+ * data array plus the row length. The view is invalidated by any operation
+ * that reallocates the underlying list (push_back, +=, clear, ...).
+ * Use to_vector() when an owning copy is really needed.
+ */
+template <typename T> struct CSRListView {
+    using value_type = T;
+    using size_type = std::size_t;
+    using const_iterator = const T *;
+
+    CSRListView() : _begin(nullptr), _size(0) {}
+
+    CSRListView(const T *begin, size_type size) : _begin(begin), _size(size) {}
+
+    const_iterator begin() const noexcept { return _begin; }
+
+    const_iterator end() const noexcept { return _begin + _size; }
+
+    const_iterator cbegin() const noexcept { return begin(); }
+
+    const_iterator cend() const noexcept { return end(); }
+
+    const T *data() const noexcept { return _begin; }
+
+    size_type size() const noexcept { return _size; }
+
+    bool empty() const noexcept { return _size == 0; }
+
+    const T &operator[](size_type i) const {
+        assert(i < _size);
+        return _begin[i];
+    }
+
+    const T &front() const { return operator[](0); }
+
+    const T &back() const { return operator[](_size - 1); }
+
+    std::vector<T> to_vector() const { return std::vector<T>(begin(), end()); }
+
+private:
+    const T *_begin;
+    size_type _size;
+};
+
+#endif // __CSRLIST_VIEW_H__
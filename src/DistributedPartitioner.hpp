@@ -0,0 +1,569 @@
+#ifndef __DISTRIBUTED_PARTITIONER_H__
+#define __DISTRIBUTED_PARTITIONER_H__
+
+#ifdef USE_PARMETIS
+
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include <mpi.h>
+#include <parmetis.h>
+
+#include "CSRList.hpp"
+#include "ElementSpace.hpp"
+#include "HDF5File.hpp"
+#include "Mesh.hpp"
+#include "MeshIO.hpp"
+#include "Parallel.hpp"
+
+/*
+ * Partitioning of a mesh that is never held by a single process. Every rank
+ * of the communicator
+ *  - reads one slice of the mesh file (MeshIO::read_slice()),
+ *  - takes part in ParMETIS_V3_PartMeshKway, which builds the distributed
+ *    dual graph of the slices and assigns one part per rank,
+ *  - receives the elements of its part and the coordinates of their nodes
+ *    through all-to-all exchanges,
+ *  - and writes its partition to a file of its own.
+ *
+ * Global node and element indices are those of the serial reader, so that
+ * nl2g and el2g refer to the same nodes and prime elements as the
+ * partition/<rank> groups written by MeshIO::write(). A node is owned by
+ * the lowest rank among its elements.
+ *
+ * @tparam D spatial dimension
+ * @tparam I index type of nodes and elements
+ */
+template <int D, typename I = std::size_t> class DistributedPartitioner {
+public:
+    explicit DistributedPartitioner(MPI_Comm comm)
+        : _comm(comm), _num_global_elements(0), _edgecut(0),
+          _num_global_nodes(0) {
+        MPI_Comm_rank(_comm, &_rank);
+        MPI_Comm_size(_comm, &_size);
+    }
+
+    int rank() const { return _rank; }
+
+    int size() const { return _size; }
+
+    /*
+     * Prime elements of the whole mesh, known after read()
+     */
+    std::size_t num_global_elements() const { return _num_global_elements; }
+
+    /*
+     * Nodes of the prime elements of the whole mesh, known after
+     * redistribute()
+     */
+    std::size_t num_global_nodes() const { return _num_global_nodes; }
+
+    /*
+     * Reads the slice of this rank, numbers the elements and spreads them
+     * evenly over the ranks. Collective.
+     * @return 1 on success, -1 if any rank failed
+     */
+    int read(const std::string &filename,
+             MeshIO::MshGenerator type = MeshIO::MshGenerator::GMSH) {
+        int status = MeshIO::read_slice(_slice, filename, _rank, _size, type);
+        MPI_Allreduce(MPI_IN_PLACE, &status, 1, MPI_INT, MPI_MIN, _comm);
+        if (status < 0) {
+            return status;
+        }
+        _number_elements();
+        _balance_elements();
+        return 1;
+    }
+
+    /*
+     * Partitions the elements read by all ranks into one part per rank.
+     * Elements sharing a facet are neighbors in the dual graph; the weight
+     * of an element is its number of vertices, as in MeshPartitioner::metis.
+     * Collective.
+     * @return 1 on success, -1 if ParMETIS failed
+     */
+    int partition() {
+        const auto &elements = _slice.elements;
+        const idx_t num_elements = elements.size();
+        _part.assign(num_elements, 0);
+        if (_size < 2) {
+            return 1;
+        }
+
+        std::vector<idx_t> elmdist(_size + 1, 0);
+        MPI_Allgather(&num_elements, 1, IDX_T, elmdist.data() + 1, 1, IDX_T,
+                      _comm);
+        std::partial_sum(elmdist.begin(), elmdist.end(), elmdist.begin());
+        // ParMETIS needs elements on every rank
+        if (elmdist.back() < _size) {
+            if (_rank == 0) {
+                std::cerr << "Fewer elements than ranks" << std::endl;
+            }
+            return -1;
+        }
+
+        std::vector<idx_t> eptr(elements.offset().begin(),
+                                elements.offset().end());
+        std::vector<idx_t> eind(elements.data().begin(),
+                                elements.data().end());
+        std::vector<idx_t> elmwgt(num_elements);
+        for (idx_t i = 0; i < num_elements; ++i) {
+            elmwgt[i] = eptr[i + 1] - eptr[i];
+        }
+
+        idx_t ncommon = std::numeric_limits<idx_t>::max();
+        for (auto t : ElementSpace<D>::prime_element_types()) {
+            if (_slice.type_count[static_cast<std::size_t>(t)]) {
+                ncommon = std::min<idx_t>(
+                    ncommon, ElementSpace<D>::min_facet_vertices(t));
+            }
+        }
+        MPI_Allreduce(MPI_IN_PLACE, &ncommon, 1, IDX_T, MPI_MIN, _comm);
+
+        idx_t wgtflag = 2, numflag = 0, ncon = 1, nparts = _size;
+        std::vector<real_t> tpwgts(nparts, 1.0 / nparts);
+        real_t ubvec = 1.05;
+        idx_t options[3] = {0, 0, 0};
+        idx_t edgecut = 0;
+        MPI_Comm comm = _comm;
+        auto status = ParMETIS_V3_PartMeshKway(
+            elmdist.data(), eptr.data(), eind.data(), elmwgt.data(), &wgtflag,
+            &numflag, &ncon, &ncommon, &nparts, tpwgts.data(), &ubvec, options,
+            &edgecut, _part.data(), &comm);
+        if (status != METIS_OK) {
+            std::cerr << "ParMETIS_V3_PartMeshKway failed" << std::endl;
+            return -1;
+        }
+        _edgecut = edgecut;
+        return 1;
+    }
+
+    /*
+     * Number of dual graph edges cut by partition()
+     */
+    idx_t edgecut() const { return _edgecut; }
+
+    /*
+     * Sends every element to the rank of its part and gathers the nodes of
+     * the received elements from the ranks whose slices hold them. The
+     * result is local_mesh(), with the partitions of all ranks installed so
+     * that local_mesh().local_mesh_data(rank()) yields this partition.
+     * Collective.
+     * @return 1 on success, -1 if a node is missing from all slices
+     */
+    int redistribute() {
+        std::vector<int> destination(_part.begin(), _part.end());
+        const auto num_types = _slice.type_count.size();
+        auto [received, records] = _exchange_elements(destination);
+
+        // the nodes of the local elements, sorted by global index
+        _node_index.clear();
+        for (auto pos : records) {
+            auto vertices = received.begin() + pos + 4;
+            _node_index.insert(_node_index.end(), vertices,
+                               vertices + received[pos + 3]);
+        }
+        std::sort(_node_index.begin(), _node_index.end());
+        _node_index.erase(std::unique(_node_index.begin(), _node_index.end()),
+                          _node_index.end());
+
+        std::vector<double> coordinates;
+        std::vector<int> owner;
+        if (_fetch_nodes(coordinates, owner) < 0) {
+            return -1;
+        }
+
+        // the local mesh: one Vertex element per node, then the prime
+        // elements grouped by type
+        auto &mesh = _mesh;
+        const auto num_nodes = _node_index.size();
+        mesh.nodes() = std::move(coordinates);
+        std::vector<I> data(num_nodes);
+        std::vector<std::size_t> offset(num_nodes + 1);
+        std::iota(data.begin(), data.end(), static_cast<I>(0));
+        std::iota(offset.begin(), offset.end(), 0);
+        std::vector<I> element_ID(num_nodes, 0);
+        std::vector<std::size_t> count(num_types, 0);
+        count[static_cast<std::size_t>(FiniteElementType::Vertex)] = num_nodes;
+        _cell_index.clear();
+        for (auto pos : records) {
+            auto t = received[pos + 2];
+            for (std::int64_t j = 0; j < received[pos + 3]; ++j) {
+                data.push_back(std::lower_bound(_node_index.begin(),
+                                                _node_index.end(),
+                                                received[pos + 4 + j]) -
+                               _node_index.begin());
+            }
+            offset.push_back(data.size());
+            element_ID.push_back(received[pos + 1]);
+            _cell_index.push_back(received[pos]);
+            ++count[t];
+        }
+        mesh.elements() = {CSRList<I>(std::move(data), std::move(offset)),
+                           std::move(element_ID)};
+        auto &type_offset = mesh.type_offset();
+        type_offset.assign(1, 0);
+        for (auto n : count) {
+            type_offset.push_back(type_offset.back() + n);
+        }
+
+        // all prime elements belong to this rank, every node to its owner
+        std::vector<std::size_t> element_offset(_size + 1, 0);
+        std::fill(element_offset.begin() + _rank + 1, element_offset.end(),
+                  records.size());
+        std::vector<I> prime(records.size());
+        std::iota(prime.begin(), prime.end(), static_cast<I>(0));
+        std::vector<std::size_t> node_offset(_size + 1, 0);
+        for (auto r : owner) {
+            ++node_offset[r + 1];
+        }
+        std::partial_sum(node_offset.begin(), node_offset.end(),
+                         node_offset.begin());
+        std::vector<I> nodes(num_nodes);
+        {
+            auto cursor = node_offset;
+            for (std::size_t i = 0; i < num_nodes; ++i) {
+                nodes[cursor[owner[i]]++] = i;
+            }
+        }
+        mesh.set_partitions(
+            CSRList<I>(std::move(prime), std::move(element_offset)),
+            CSRList<I>(std::move(nodes), std::move(node_offset)));
+        return 1;
+    }
+
+    /*
+     * The elements of this rank and their nodes, numbered locally;
+     * global_node_index() and global_element_index() map back.
+     */
+    const Mesh<D, I> &local_mesh() const { return _mesh; }
+
+    Mesh<D, I> &local_mesh() { return _mesh; }
+
+    const std::vector<std::int64_t> &global_node_index() const {
+        return _node_index;
+    }
+
+    const std::vector<std::int64_t> &global_element_index() const {
+        return _cell_index;
+    }
+
+    /*
+     * This partition as (nl2g, ghost, el2g) in global indices, with the
+     * local nodes ordered by local_mesh().ordering().
+     */
+    auto partition_data() const {
+        auto [node, is_ghosted, element] = _mesh.local_mesh_data(_rank);
+        for (auto &i : node) {
+            i = _node_index[i];
+        }
+        for (auto &i : element) {
+            i = _cell_index[i];
+        }
+        return std::make_tuple(node, is_ghosted, element);
+    }
+
+    /*
+     * Writes this partition to <prefix>.<rank>.h5: the node coordinates
+     * and the elements (node, element, ID) in the local numbering of nl2g,
+     * and partition/nl2g, partition/ghost and partition/el2g as written by
+     * MeshIO::write() for partition <rank>.
+     * @return 1 on success, -1 on error
+     */
+    int write(const std::string &prefix,
+              HDF5File::StorageOptions storage = {}) const {
+        auto [node, is_ghosted, element] = _mesh.local_mesh_data(_rank);
+        std::vector<I> renumber(node.size());
+        std::vector<double> coordinates;
+        coordinates.reserve(node.size() * D);
+        for (std::size_t i = 0; i < node.size(); ++i) {
+            renumber[node[i]] = i;
+            coordinates.insert(coordinates.end(),
+                               _mesh.nodes().begin() + node[i] * D,
+                               _mesh.nodes().begin() + (node[i] + 1) * D);
+        }
+        const auto &prime = _mesh.element_collections(D);
+        const auto &prime_ID = _mesh.elements(D).second;
+        CSRList<I> local_elements;
+        std::vector<I> local_ID;
+        for (auto e : element) {
+            auto vertices = prime[e].to_vector();
+            for (auto &v : vertices) {
+                v = renumber[v];
+            }
+            local_elements.push_back(vertices);
+            local_ID.push_back(prime_ID[e]);
+        }
+        for (auto &i : node) {
+            i = _node_index[i];
+        }
+        for (auto &i : element) {
+            i = _cell_index[i];
+        }
+
+        auto filename = prefix + "." + std::to_string(_rank) + ".h5";
+        try {
+            HDF5File file(filename, "w", storage);
+            file.write(coordinates, "node");
+            file.write(local_elements, "element");
+            file.write(local_ID, "ID");
+            file.write(node, "partition/nl2g");
+            file.write(is_ghosted, "partition/ghost");
+            file.write(element, "partition/el2g");
+            file.write(_rank, "partition/rank");
+            file.write(_size, "partition/size");
+        } catch (const std::exception &e) {
+            std::cerr << "Cannot write " << filename << ": " << e.what()
+                      << std::endl;
+            return -1;
+        }
+        return 1;
+    }
+
+private:
+    /*
+     * Global index of every element of the slice: the prime elements of
+     * one type follow those of the preceding types, and within a type the
+     * slices follow each other in rank order.
+     */
+    void _number_elements() {
+        const auto num_types = _slice.type_count.size();
+        std::vector<std::int64_t> count(_slice.type_count.begin(),
+                                        _slice.type_count.end());
+        std::vector<std::int64_t> before(num_types, 0), total(num_types, 0);
+        MPI_Exscan(count.data(), before.data(), num_types, MPI_INT64_T,
+                   MPI_SUM, _comm);
+        if (_rank == 0) {
+            std::fill(before.begin(), before.end(), 0);
+        }
+        MPI_Allreduce(count.data(), total.data(), num_types, MPI_INT64_T,
+                      MPI_SUM, _comm);
+        _element_index.clear();
+        std::int64_t first = 0;
+        for (std::size_t t = 0; t < num_types; ++t) {
+            for (std::int64_t k = 0; k < count[t]; ++k) {
+                _element_index.push_back(first + before[t] + k);
+            }
+            first += total[t];
+        }
+        _num_global_elements = first;
+    }
+
+    /*
+     * Moves the elements so that rank r holds the r-th of size() blocks of
+     * consecutive global indices: the slices of the file may contain few or
+     * no prime elements, e.g. when the boundary facets come first, but
+     * ParMETIS expects a balanced distribution with elements on every rank.
+     */
+    void _balance_elements() {
+        std::vector<std::size_t> first(_size + 1);
+        for (int r = 0; r <= _size; ++r) {
+            first[r] = parallel::chunk_begin(_num_global_elements, _size, r);
+        }
+        std::vector<int> destination(_element_index.size());
+        for (std::size_t row = 0; row < destination.size(); ++row) {
+            destination[row] =
+                std::upper_bound(
+                    first.begin(), first.end(),
+                    static_cast<std::size_t>(_element_index[row])) -
+                first.begin() - 1;
+        }
+        auto [received, records] = _exchange_elements(destination);
+
+        auto &type_count = _slice.type_count;
+        std::fill(type_count.begin(), type_count.end(), 0);
+        std::vector<I> data;
+        std::vector<std::size_t> offset(1, 0);
+        _slice.element_ID.clear();
+        _element_index.clear();
+        for (auto pos : records) {
+            auto vertices = received.begin() + pos + 4;
+            data.insert(data.end(), vertices, vertices + received[pos + 3]);
+            offset.push_back(data.size());
+            _slice.element_ID.push_back(received[pos + 1]);
+            _element_index.push_back(received[pos]);
+            ++type_count[received[pos + 2]];
+        }
+        _slice.elements = CSRList<I>(std::move(data), std::move(offset));
+    }
+
+    /*
+     * Sends every element of the slice to rank destination[row] as a record
+     * (global index, ID, type, #vertices, vertices).
+     * @return the received records and their positions, sorted by global
+     * index and thus grouped by type
+     */
+    std::pair<std::vector<std::int64_t>, std::vector<std::size_t>>
+    _exchange_elements(const std::vector<int> &destination) const {
+        const auto num_types = _slice.type_count.size();
+        std::vector<std::vector<std::int64_t>> cells(_size);
+        for (std::size_t t = 0, row = 0; t < num_types; ++t) {
+            for (std::size_t k = 0; k < _slice.type_count[t]; ++k, ++row) {
+                auto &buffer = cells[destination[row]];
+                auto element = _slice.elements[row];
+                buffer.push_back(_element_index[row]);
+                buffer.push_back(_slice.element_ID[row]);
+                buffer.push_back(t);
+                buffer.push_back(element.size());
+                buffer.insert(buffer.end(), element.begin(), element.end());
+            }
+        }
+        auto received = std::get<0>(_all_to_all(cells));
+        std::vector<std::size_t> records;
+        for (std::size_t pos = 0; pos < received.size();
+             pos += 4 + received[pos + 3]) {
+            records.push_back(pos);
+        }
+        std::sort(records.begin(), records.end(),
+                  [&](std::size_t a, std::size_t b) {
+                      return received[a] < received[b];
+                  });
+        return {std::move(received), std::move(records)};
+    }
+
+    /*
+     * Coordinates and owner of every node in _node_index. The requests go
+     * to the ranks whose slices hold the nodes; those take the lowest
+     * requesting rank as the owner before answering.
+     */
+    int _fetch_nodes(std::vector<double> &coordinates,
+                     std::vector<int> &owner) {
+        std::int64_t slice[2] = {
+            static_cast<std::int64_t>(_slice.first_node),
+            static_cast<std::int64_t>(_slice.nodes.size() / D)};
+        std::vector<std::int64_t> slices(2 * _size);
+        MPI_Allgather(slice, 2, MPI_INT64_T, slices.data(), 2, MPI_INT64_T,
+                      _comm);
+        // the non-empty slices, whose ranges ascend with the rank
+        std::vector<int> holders;
+        std::vector<std::int64_t> first;
+        for (int r = 0; r < _size; ++r) {
+            if (slices[2 * r + 1] > 0) {
+                holders.push_back(r);
+                first.push_back(slices[2 * r]);
+            }
+        }
+        auto holder = [&](std::int64_t node) {
+            auto k = std::upper_bound(first.begin(), first.end(), node) -
+                     first.begin() - 1;
+            if (k < 0 or node >= first[k] + slices[2 * holders[k] + 1]) {
+                return -1;
+            }
+            return holders[k];
+        };
+
+        int status = 1;
+        std::vector<std::vector<std::int64_t>> requests(_size);
+        for (auto node : _node_index) {
+            auto r = holder(node);
+            if (r < 0) {
+                status = -1;
+                break;
+            }
+            requests[r].push_back(node);
+        }
+        MPI_Allreduce(MPI_IN_PLACE, &status, 1, MPI_INT, MPI_MIN, _comm);
+        if (status < 0) {
+            std::cerr << "Nodes missing from the mesh file" << std::endl;
+            return -1;
+        }
+        auto [requested, sources] = _all_to_all(requests);
+
+        std::vector<int> lowest(slice[1], _size);
+        for (int r = 0; r < _size; ++r) {
+            for (auto k = sources[r]; k < sources[r + 1]; ++k) {
+                auto &o = lowest[requested[k] - slice[0]];
+                o = std::min(o, r);
+            }
+        }
+        std::int64_t num_nodes =
+            std::count_if(lowest.begin(), lowest.end(),
+                          [this](int r) { return r < _size; });
+        MPI_Allreduce(MPI_IN_PLACE, &num_nodes, 1, MPI_INT64_T, MPI_SUM,
+                      _comm);
+        _num_global_nodes = num_nodes;
+        std::vector<std::vector<double>> coordinate_replies(_size);
+        std::vector<std::vector<std::int64_t>> owner_replies(_size);
+        for (int r = 0; r < _size; ++r) {
+            for (auto k = sources[r]; k < sources[r + 1]; ++k) {
+                auto i = requested[k] - slice[0];
+                coordinate_replies[r].insert(
+                    coordinate_replies[r].end(),
+                    _slice.nodes.begin() + i * D,
+                    _slice.nodes.begin() + (i + 1) * D);
+                owner_replies[r].push_back(lowest[i]);
+            }
+        }
+        // the replies arrive in the order of _node_index: the requests to
+        // each rank are ascending and the ranks hold ascending ranges
+        coordinates = std::get<0>(_all_to_all(coordinate_replies));
+        auto owners = std::get<0>(_all_to_all(owner_replies));
+        owner.assign(owners.begin(), owners.end());
+        return 1;
+    }
+
+    template <typename T> static MPI_Datatype _mpi_type() {
+        if constexpr (std::is_same_v<T, double>) {
+            return MPI_DOUBLE;
+        } else {
+            static_assert(std::is_same_v<T, std::int64_t>);
+            return MPI_INT64_T;
+        }
+    }
+
+    /*
+     * Sends send[r] to rank r.
+     * @return the received data, by source rank, and the position of the
+     * data of every source rank (size() + 1 entries)
+     */
+    template <typename T>
+    std::pair<std::vector<T>, std::vector<int>>
+    _all_to_all(const std::vector<std::vector<T>> &send) const {
+        std::vector<int> send_count(_size), send_offset(_size + 1, 0);
+        std::vector<int> receive_count(_size), receive_offset(_size + 1, 0);
+        for (int r = 0; r < _size; ++r) {
+            send_count[r] = send[r].size();
+            send_offset[r + 1] = send_offset[r] + send_count[r];
+        }
+        MPI_Alltoall(send_count.data(), 1, MPI_INT, receive_count.data(), 1,
+                     MPI_INT, _comm);
+        std::partial_sum(receive_count.begin(), receive_count.end(),
+                         receive_offset.begin() + 1);
+        std::vector<T> send_buffer;
+        send_buffer.reserve(send_offset.back());
+        for (const auto &s : send) {
+            send_buffer.insert(send_buffer.end(), s.begin(), s.end());
+        }
+        std::vector<T> receive_buffer(receive_offset.back());
+        MPI_Alltoallv(send_buffer.data(), send_count.data(), send_offset.data(),
+                      _mpi_type<T>(), receive_buffer.data(),
+                      receive_count.data(), receive_offset.data(),
+                      _mpi_type<T>(), _comm);
+        return {std::move(receive_buffer), std::move(receive_offset)};
+    }
+
+    MPI_Comm _comm;
+    int _rank, _size;
+    MeshIO::Slice<D, I> _slice;
+    // global index of every element of the slice and its part
+    std::vector<std::int64_t> _element_index;
+    std::size_t _num_global_elements;
+    std::vector<idx_t> _part;
+    idx_t _edgecut;
+    std::size_t _num_global_nodes;
+    // the elements of this rank; global index of its nodes and elements
+    Mesh<D, I> _mesh;
+    std::vector<std::int64_t> _node_index, _cell_index;
+};
+
+#endif // USE_PARMETIS
+
+#endif // __DISTRIBUTED_PARTITIONER_H__
@@ -0,0 +1,148 @@
+#ifndef __DRIVER_H__
+#define __DRIVER_H__
+
+#include <algorithm>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "HDF5File.hpp"
+#include "Mesh.hpp"
+#include "MeshIO.hpp"
+#include "ParameterParser.hpp"
+#include "Partitioning.hpp"
+#include "Reorder.hpp"
+
+/*
+ * The steps of the serial partitioner (main_serial.cpp), each driven by its
+ * group of command line options. They return 1 on success and -1 on error
+ * like MeshIO; option values that cannot be parsed throw.
+ */
+namespace driver {
+
+/*
+ * Reads the mesh given by --input, through the snapshot given by --cache
+ * if any.
+ * @return the result of MeshIO::read: 2 if the snapshot was loaded
+ */
+template <int D, typename I>
+int read(Mesh<D, I> &mesh, const ParameterParser &cli) {
+    if (not cli.has("input")) {
+        std::cerr << "No input mesh, see --help" << std::endl;
+        return -1;
+    }
+    auto input = cli.eval<std::string>("input");
+    auto status =
+        cli.has("cache")
+            ? MeshIO::read(mesh, input, cli.eval<std::string>("cache"))
+            : MeshIO::read(mesh, input);
+    if (status < 0) {
+        std::cerr << "Cannot read the mesh " << input << std::endl;
+    }
+    return status;
+}
+
+/*
+ * Partitions the mesh into --num parts (one without it) with the
+ * --partitioner backend and numbers the local nodes by --ordering. The
+ * METIS load balance follows --element_weights and --balance_facets.
+ */
+template <int D, typename I>
+int partition(Mesh<D, I> &mesh, const ParameterParser &cli) {
+    auto method =
+        partitioning::method_from_string(cli.eval<std::string>("partitioner"));
+    mesh.set_ordering(reordering::ordering_from_string(
+        cli.eval<std::string>("ordering")));
+    for (auto [type, weight] : partitioning::element_weights_from_string(
+             cli.eval<std::string>("element_weights"))) {
+        mesh.set_element_weight(type, weight);
+    }
+    mesh.balance_boundary_facets(cli.eval<bool>("balance_facets"));
+    auto num_parts = cli.has("num") ? std::max(cli.eval<int>("num"), 1) : 1;
+    mesh.partition(num_parts, method);
+    return 1;
+}
+
+/*
+ * Chunking and compression of the HDF5 output: --compression is the
+ * deflate level, --chunk_size the chunk size in KiB.
+ */
+inline HDF5File::StorageOptions storage_options(const ParameterParser &cli) {
+    auto deflate = cli.eval<int>("compression");
+    auto chunk_size = cli.eval<int>("chunk_size");
+    if (deflate < 0 or deflate > 9) {
+        throw std::invalid_argument("compression must be in 0-9");
+    }
+    if (chunk_size <= 0) {
+        throw std::invalid_argument("chunk_size must be positive");
+    }
+    HDF5File::StorageOptions storage;
+    storage.deflate = deflate;
+    storage.chunk_bytes = static_cast<std::size_t>(chunk_size) << 10;
+    return storage;
+}
+
+/*
+ * Writes the partitioned mesh to --output with the storage_options();
+ * nothing is written without it.
+ */
+template <int D, typename I>
+int write(const Mesh<D, I> &mesh, const ParameterParser &cli) {
+    if (not cli.has("output")) {
+        return 1;
+    }
+    auto output = cli.eval<std::string>("output");
+    if (MeshIO::write(mesh, output, storage_options(cli)) < 0) {
+        std::cerr << "Cannot write the mesh " << output << std::endl;
+        return -1;
+    }
+    return 1;
+}
+
+/*
+ * Writes the partition quality report (JSON) to --quality; nothing is
+ * written without it.
+ */
+template <int D, typename I>
+int report(const Mesh<D, I> &mesh, const ParameterParser &cli) {
+    if (not cli.has("quality")) {
+        return 1;
+    }
+    auto filename = cli.eval<std::string>("quality");
+    std::ofstream file(filename);
+    file << mesh.quality().to_json();
+    if (not file) {
+        std::cerr << "Cannot write the quality report " << filename
+                  << std::endl;
+        return -1;
+    }
+    return 1;
+}
+
+/*
+ * Reads, partitions and writes a 3D mesh, then reports its quality.
+ * @return the exit status of the program
+ */
+inline int run(const ParameterParser &cli) {
+    if (cli.has("help")) {
+        std::cout << cli;
+        return 0;
+    }
+    Mesh<3> mesh;
+    try {
+        if (read(mesh, cli) < 0 or partition(mesh, cli) < 0 or
+            write(mesh, cli) < 0 or report(mesh, cli) < 0) {
+            return 1;
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+} // namespace driver
+
+#endif // __DRIVER_H__
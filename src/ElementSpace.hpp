@@ -1,6 +1,9 @@
 #ifndef __ELEMENT_SPACE_H__
 #define __ELEMENT_SPACE_H__
 
+#include <algorithm>
+#include <array>
+#include <cassert>
 #include <type_traits>
 #include <vector>
 
@@ -118,6 +121,50 @@ public:
         return {};
     }
 
+    /*
+     * local vertex pairs of the edges of an element. For 2D elements these
+     * are the subentities; for 3D elements they are collected from the edges
+     * of every face, each edge listed once in order of first appearance.
+     */
+    static std::vector<std::array<std::size_t, 2>>
+    edge_indices(FiniteElementType type) {
+        std::vector<std::array<std::size_t, 2>> edges;
+        auto add_edges = [&edges](FiniteElementType face_type,
+                                  const std::vector<std::size_t> &face) {
+            for (std::size_t i = 0;; ++i) {
+                auto local = subentity_indices(face_type, i);
+                if (local.size() != 2) {
+                    break;
+                }
+                std::array<std::size_t, 2> edge = {face[local[0]],
+                                                   face[local[1]]};
+                auto found = std::any_of(
+                    edges.begin(), edges.end(), [&](const auto &e) {
+                        return (e[0] == edge[0] and e[1] == edge[1]) or
+                               (e[0] == edge[1] and e[1] == edge[0]);
+                    });
+                if (not found) {
+                    edges.push_back(edge);
+                }
+            }
+        };
+        if (type == FiniteElementType::Triangle or
+            type == FiniteElementType::Quadrangle) {
+            add_edges(type, {0, 1, 2, 3});
+        } else {
+            for (std::size_t i = 0;; ++i) {
+                auto face = subentity_indices(type, i);
+                if (face.size() < 3) {
+                    break;
+                }
+                add_edges(face.size() == 3 ? FiniteElementType::Triangle
+                                           : FiniteElementType::Quadrangle,
+                          face);
+            }
+        }
+        return edges;
+    }
+
     static std::size_t
     subentity_indices(FiniteElementType type,
                       const std::vector<std::size_t> &indices) {
@@ -262,6 +309,29 @@ template <int D> struct ElementSpace {
         }
         return Type::All;
     }
+
+    // fewest vertices of a facet of the element type, i.e. the number of
+    // vertices two face neighbors share at least
+    static int min_facet_vertices(Type type) {
+        switch (type) {
+        case Type::Line:
+            return 1;
+        case Type::Triangle:
+        case Type::Quadrangle:
+            return 2;
+        case Type::Tetrahedron:
+        case Type::Prism:
+        case Type::Pyramid:
+            return 3;
+        case Type::Hexahedron:
+            return 4;
+        case Type::IGA2:
+            return 9;
+        default:
+            return 1;
+        }
+    }
+
     template <Type type,
               typename std::enable_if_t<is_compatible_v<type>> * = nullptr>
     struct Element {
@@ -1,29 +1,58 @@
 #ifndef __HDF5FILE_H__
 #define __HDF5FILE_H__
 
+#include <algorithm>
+#include <array>
 #include <highfive/H5File.hpp>
 #include <memory>
+#include <numeric>
+#include <string>
+#include <tuple>
+#include <vector>
 
 #include "Mesh.hpp"
+#include "Parallel.hpp"
 
 namespace h5 = HighFive;
+
+/**
+ * @brief storage of the datasets created by write()
+ *  Arrays of at least min_chunked_bytes are chunked and filtered; a
+ * chunk holds chunk_bytes, or the whole array if it is smaller, so one
+ * partition's array is read back with a single chunk in most cases.
+ * Smaller arrays (scalars, offsets of tiny partitions) and empty ones
+ * stay contiguous.
+ */
+struct HDF5StorageOptions {
+    std::size_t chunk_bytes = 1 << 20;
+    std::size_t min_chunked_bytes = 1 << 12;
+    // deflate (gzip) level, 0 disables compression
+    unsigned deflate = 4;
+    // byte shuffle before deflate, helps integer and double arrays
+    bool shuffle = true;
+};
+
 class HDF5File {
 public:
+    using StorageOptions = HDF5StorageOptions;
+
     /**
      * @brief Construct a new HDF5File object
      *  The HDF5File is based HighFive and HDF5. It provides read/write access
      * to common stl templates. It also has interface to Mesh<int>
      * @param filename
      * @param open_flag: "r" (Read) or "w" (Write)
+     * @param storage: chunking and compression of the written datasets
      */
-    HDF5File(std::string filename, std::string open_flag) : _file(nullptr) {
+    HDF5File(std::string filename, std::string open_flag,
+             StorageOptions storage = StorageOptions())
+        : _file(nullptr), _storage(storage) {
         if (open_flag == "w") {
             _file = std::make_unique<h5::File>(
                 filename,
                 h5::File::ReadWrite | h5::File::Create | h5::File::Truncate);
         } else if (open_flag == "r") {
-            _file = std::make_unique<h5::File>(filename, h5::File::ReadOnly |
-                                                             h5::File::Create);
+            _file = std::make_unique<h5::File>(filename, h5::File::ReadOnly);
         } else {
             assert(false and "Invalid open flag");
         }
@@ -88,76 +117,321 @@ public:
      * @brief write a mesh
      *
      * @tparam D: integer, dimension
+     * @tparam I: index type of the mesh
      * @param mesh: mesh to write
      * @param datapath: path to data
      */
-    template <int D> void write(const Mesh<D> &mesh, std::string datapath) {
+    template <int D, typename I>
+    void write(const Mesh<D, I> &mesh, std::string datapath) {
         static_assert(0 <= D and D <= 3, "D must be between 0 and 3");
         // write global data, including nodal coordinates, element, and element
         // ID
         auto localpath = datapath;
         regulerize_path(localpath);
         write(mesh.nodes(), localpath + "node");
-        if constexpr (D == 3) {
-            // D == 2
+        if constexpr (D >= 2) {
+            // D - 1
             {
-                auto info = mesh.elements(2);
+                auto info = mesh.elements(D - 1);
                 write(info.first, localpath + "secondary/element");
                 write(info.second, localpath + "secondary/ID");
             }
-            // D == 3
+            // D
             {
-                auto info = mesh.elements(3);
+                auto info = mesh.elements(D);
                 write(info.first, localpath + "prime/element");
                 write(info.second, localpath + "prime/ID");
             }
-        } else if constexpr (D == 2) {
-        } else if constexpr (D == 1) {
-        } else if constexpr (D == 0) {
-        } else {
         }
+        write(_stored_type_offset(mesh), localpath + "type_offset");
         write(mesh.adjacent_vertices(), localpath + "adjacency");
 
-        // write local data
-        auto num_parts = mesh.num_partitions();
-        auto conn = mesh.connectivity(D - 1, D);
-        auto orientation = mesh.orientation();
+        // write local data: the partitions are built concurrently and
+        // written one at a time by this thread; an unpartitioned mesh has none
+        std::size_t num_parts = mesh.num_partitions();
+        if (num_parts == 0) {
+            return;
+        }
+        const auto &conn = mesh.connectivity(D - 1, D);
+        const auto &orientation = mesh.orientation();
         assert(conn.size() == orientation.size());
-        for (std::size_t i = 0; i < num_parts; ++i) {
-            auto [node, is_ghosted, element] = mesh.local_mesh_data(i);
-            write(node, localpath + "partition/" + std::to_string(i) + "/nl2g");
-            write(is_ghosted,
-                  localpath + "partition/" + std::to_string(i) + "/ghost");
-            write(element,
-                  localpath + "partition/" + std::to_string(i) + "/el2g");
-            // generate array for secondary elements
-            std::vector<std::size_t> attach;
-            std::vector<std::size_t> orient;
-
-            for (std::size_t ifacet = 0; ifacet < conn.size(); ++ifacet) {
-                auto f2e = conn[ifacet];
-                auto forient = orientation[ifacet];
-                assert(f2e.size() == forient.size());
-                for (std::size_t ielem = 0; ielem < f2e.size(); ++ielem) {
-                    auto it =
-                        std::find(element.begin(), element.end(), f2e[ielem]);
-                    if (it == element.end()) {
-                        auto local_element_idx =
-                            std::distance(element.begin(), it);
-                        attach.push_back(local_element_idx);
-                        orient.push_back(forient[ielem]);
-                    }
+        mesh.element_collections(D);
+        const auto &element_rank = mesh.element_rank();
+        const auto &element_local_index = mesh.element_local_index();
+        write(element_rank, localpath + "partition/element/rank");
+        write(element_local_index, localpath + "partition/element/local");
+
+        // facets of each rank in one pass over the facets: the facet ID and
+        // the attached local element and orientation, in facet order
+        struct Facets {
+            std::vector<I> id;
+            std::vector<I> attach;
+            std::vector<I> orient;
+        };
+        std::vector<Facets> facets(num_parts);
+        for (std::size_t ifacet = 0; ifacet < conn.size(); ++ifacet) {
+            auto f2e = conn[ifacet];
+            auto forient = orientation[ifacet];
+            assert(f2e.size() == forient.size());
+            for (std::size_t ielem = 0; ielem < f2e.size(); ++ielem) {
+                auto &rank_facets = facets[element_rank[f2e[ielem]]];
+                rank_facets.id.push_back(ifacet);
+                rank_facets.attach.push_back(element_local_index[f2e[ielem]]);
+                rank_facets.orient.push_back(forient[ielem]);
+            }
+        }
+
+        struct Partition {
+            std::size_t rank;
+            std::vector<I> node;
+            std::vector<int> is_ghosted;
+            std::vector<I> element;
+        };
+        parallel::pipeline(
+            num_parts, mesh.num_threads(),
+            [&](std::size_t rank) {
+                Partition part;
+                part.rank = rank;
+                std::tie(part.node, part.is_ghosted, part.element) =
+                    mesh.local_mesh_data(rank);
+                return part;
+            },
+            [&](Partition &&part) {
+                auto partpath =
+                    localpath + "partition/" + std::to_string(part.rank);
+                write(part.node, partpath + "/nl2g");
+                write(part.is_ghosted, partpath + "/ghost");
+                write(part.element, partpath + "/el2g");
+                // facets attached to the local elements
+                auto &rank_facets = facets[part.rank];
+                write(rank_facets.id, partpath + "/facet/id");
+                write(rank_facets.attach, partpath + "/facet/e");
+                write(rank_facets.orient, partpath + "/facet/o");
+                rank_facets = Facets();
+            });
+
+        // partition quality as attributes of the partition group
+        _write_quality(mesh.quality(), localpath + "partition");
+    }
+
+    /**
+     * @brief whether a dataset or group exists at datapath
+     */
+    bool exist(std::string datapath) const { return _file->exist(datapath); }
+
+    /**
+     * @brief attach an attribute to the group at grouppath, which is created
+     * if needed; an attribute of the same name is replaced
+     * @tparam T scalar, std::string or std::vector of scalars
+     */
+    template <typename T>
+    void write_attribute(const T &value, std::string grouppath,
+                         const std::string &name) {
+        auto group = _file->exist(grouppath) ? _file->getGroup(grouppath)
+                                             : _file->createGroup(grouppath);
+        if (group.hasAttribute(name)) {
+            group.deleteAttribute(name);
+        }
+        group.createAttribute(name, value);
+    }
+
+    /**
+     * @brief read an attribute written by write_attribute()
+     */
+    template <typename T>
+    void read_attribute(T &value, std::string grouppath,
+                        const std::string &name) const {
+        _file->getGroup(grouppath).getAttribute(name).read(value);
+    }
+
+    /**
+     * @brief read std::vector written by write(const std::vector<T> &)
+     *
+     * @tparam T typename in std::vector
+     * @param vec: std::vector to read into
+     * @param datapath: path to data
+     */
+    template <typename T> void read(std::vector<T> &vec, std::string datapath) {
+        _read_vector(vec, datapath);
+    }
+
+    /**
+     * @brief read a scalar (including integer or floating point)
+     *
+     * @tparam T scalar type
+     * @param data: data to read into
+     * @param datapath: path to data
+     */
+    template <typename T, typename = std::enable_if_t<std::is_scalar_v<T>>>
+    void read(T &data, std::string datapath) {
+        _read_scalar(data, datapath);
+    }
+
+    /**
+     * @brief read a tuple
+     *
+     * @tparam Ts
+     * @param pack: data to read into
+     * @param datapath: path to data
+     */
+    template <typename... Ts>
+    void read(std::tuple<Ts...> &pack, std::string datapath) {
+        _read_tuple<0, Ts...>(pack, datapath);
+    }
+
+    /**
+     * @brief read a CSRList
+     *
+     * @tparam T
+     * @tparam U
+     * @tparam is_directed
+     * @param csrlist
+     * @param datapath
+     */
+    template <typename T, typename U, bool is_directed>
+    void read(CSRList<T, U, std::bool_constant<is_directed>> &csrlist,
+              std::string datapath) {
+        _read_csrlist(csrlist, datapath);
+    }
+
+    /**
+     * @brief read a mesh written by write(const Mesh<D, I> &, ...)
+     *  The elements are the vertices followed by the secondary and the prime
+     * elements; type_offset is inferred from the element sizes if the file
+     * does not store it. The vertex adjacency and the partitions (prime
+     * elements and owned nodes of each rank) are restored, so neither has to
+     * be computed again.
+     * @tparam D: integer, dimension
+     * @tparam I: index type of the mesh
+     * @param mesh: mesh to read into
+     * @param datapath: path to data
+     */
+    template <int D, typename I>
+    void read(Mesh<D, I> &mesh, std::string datapath) {
+        static_assert(0 <= D and D <= 3, "D must be between 0 and 3");
+        using FiniteElementType = typename Mesh<D, I>::FiniteElementType;
+        auto localpath = datapath;
+        regulerize_path(localpath);
+        mesh.release();
+        read(mesh.nodes(), localpath + "node");
+        const std::size_t num_nodes = mesh.nodes().size() / D;
+
+        CSRList<I> secondary, prime;
+        std::vector<I> secondary_ID, prime_ID;
+        if constexpr (D >= 2) {
+            read(secondary, localpath + "secondary/element");
+            read(secondary_ID, localpath + "secondary/ID");
+            read(prime, localpath + "prime/element");
+            read(prime_ID, localpath + "prime/ID");
+        }
+
+        // one Vertex element per node, then secondary and prime elements
+        auto &[element_info, element_ID] = mesh.elements();
+        std::vector<I> vertex_data(num_nodes);
+        std::vector<std::size_t> vertex_offset(num_nodes + 1);
+        std::iota(vertex_data.begin(), vertex_data.end(), static_cast<I>(0));
+        std::iota(vertex_offset.begin(), vertex_offset.end(), 0);
+        element_info = CSRList<I>(std::move(vertex_data),
+                                  std::move(vertex_offset));
+        element_info += secondary;
+        element_info += prime;
+        element_ID.assign(num_nodes, 0);
+        element_ID.insert(element_ID.end(), secondary_ID.begin(),
+                          secondary_ID.end());
+        element_ID.insert(element_ID.end(), prime_ID.begin(), prime_ID.end());
+
+        auto &type_offset = mesh.type_offset();
+        if (exist(localpath + "type_offset")) {
+            read(type_offset, localpath + "type_offset");
+        } else {
+            const auto num_types = ElementSpace<D>::all_element_types().size();
+            std::vector<std::size_t> count(num_types, 0);
+            count[static_cast<int>(FiniteElementType::Vertex)] = num_nodes;
+            for (auto [list, dim] : {std::pair{&secondary, D - 1},
+                                     std::pair{&prime, D}}) {
+                for (auto element : *list) {
+                    auto t = static_cast<std::size_t>(
+                        ElementSpace<D>::element_type(element.size(), dim));
+                    assert(t < num_types);
+                    ++count[t];
                 }
             }
+            type_offset.assign(1, 0);
+            for (auto n : count) {
+                type_offset.push_back(type_offset.back() + n);
+            }
+        }
+        assert(type_offset.back() == element_ID.size());
 
-            write(attach,
-                  localpath + "partition/" + std::to_string(i) + "/facet/e");
-            write(orient,
-                  localpath + "partition/" + std::to_string(i) + "/facet/o");
+        if (exist(localpath + "adjacency")) {
+            CSRList<I> adjacency;
+            read(adjacency, localpath + "adjacency");
+            mesh.adopt_adjacent_vertices(std::move(adjacency));
+        }
+
+        // partitions; the owned nodes are the ones not flagged as ghosts
+        CSRList<I> subdomain_elements, subdomain_nodes;
+        for (std::size_t i = 0;
+             exist(localpath + "partition/" + std::to_string(i)); ++i) {
+            auto partpath = localpath + "partition/" + std::to_string(i);
+            std::vector<I> node, element, owned;
+            std::vector<int> is_ghosted;
+            read(node, partpath + "/nl2g");
+            read(is_ghosted, partpath + "/ghost");
+            read(element, partpath + "/el2g");
+            assert(node.size() == is_ghosted.size());
+            for (std::size_t j = 0; j < node.size(); ++j) {
+                if (not is_ghosted[j]) {
+                    owned.push_back(node[j]);
+                }
+            }
+            std::sort(owned.begin(), owned.end());
+            subdomain_elements.push_back(element);
+            subdomain_nodes.push_back(owned);
+        }
+        if (subdomain_elements.size()) {
+            mesh.set_partitions(std::move(subdomain_elements),
+                                std::move(subdomain_nodes));
         }
     }
 
 private:
+    void _write_quality(const partitioning::Quality &quality,
+                        const std::string &grouppath) {
+        write_attribute(quality.num_parts, grouppath, "num_parts");
+        write_attribute(quality.edge_cut, grouppath, "edge_cut");
+        write_attribute(quality.metis_objective, grouppath, "metis_objective");
+        write_attribute(quality.communication_volume, grouppath,
+                        "communication_volume");
+        write_attribute(quality.element_imbalance, grouppath,
+                        "element_imbalance");
+        write_attribute(quality.elements, grouppath, "elements");
+        write_attribute(quality.owned_nodes, grouppath, "owned_nodes");
+        write_attribute(quality.ghost_nodes, grouppath, "ghost_nodes");
+        write_attribute(quality.neighbors, grouppath, "neighbors");
+        write_attribute(quality.interface_histogram, grouppath,
+                        "interface_histogram");
+    }
+
+    /**
+     * @brief type_offset of the elements as stored by write(mesh): the
+     * vertices, the secondary and the prime elements
+     */
+    template <int D, typename I>
+    static std::vector<std::size_t>
+    _stored_type_offset(const Mesh<D, I> &mesh) {
+        std::vector<std::size_t> type_offset(1, 0);
+        for (auto type : ElementSpace<D>::all_element_types()) {
+            auto [begin, end] = mesh.type_offset(type);
+            auto dim = ElementSpace<D>::topologic_dim(type);
+            bool stored = dim == 0 or (D >= 2 and dim >= D - 1) or
+                          type == Mesh<D, I>::FiniteElementType::IGA2;
+            type_offset.push_back(type_offset.back() +
+                                  (stored ? end - begin : 0));
+        }
+        return type_offset;
+    }
+
     /**
      * @brief add "/" in the path if it does not exist
      *
@@ -182,10 +456,35 @@ private:
               typename ValueType =
                   typename std::iterator_traits<Iterator>::value_type>
     void _write_1D_array(Iterator begin, Iterator end, std::string datapath) {
-        auto dim = std::distance(begin, end);
+        std::size_t dim = std::distance(begin, end);
         auto dataspace = h5::DataSpace(dim);
-        auto dataset = _file->createDataSet<ValueType>(datapath, dataspace);
-        dataset.write_raw(&(*begin));
+        auto dataset = _file->createDataSet<ValueType>(
+            datapath, dataspace, _create_props<ValueType>(dim));
+        if (dim) {
+            dataset.write_raw(&(*begin));
+        }
+    }
+
+    /**
+     * @brief dataset creation properties of an array of dim values, see
+     * StorageOptions
+     */
+    template <typename T>
+    h5::DataSetCreateProps _create_props(std::size_t dim) const {
+        h5::DataSetCreateProps props;
+        if (dim == 0 or dim * sizeof(T) < _storage.min_chunked_bytes) {
+            return props;
+        }
+        auto chunk = std::clamp<std::size_t>(_storage.chunk_bytes / sizeof(T),
+                                             1, dim);
+        props.add(h5::Chunking(std::vector<hsize_t>{chunk}));
+        if (_storage.deflate > 0) {
+            if (_storage.shuffle) {
+                props.add(h5::Shuffle());
+            }
+            props.add(h5::Deflate(std::min(_storage.deflate, 9u)));
+        }
+        return props;
     }
 
     /**
@@ -345,8 +644,56 @@ private:
         write(list.offset(), localpath + "offset");
     }
 
+    template <typename T>
+    std::vector<T> _read_1D_array(std::string datapath) const {
+        auto dataset = _file->getDataSet(datapath);
+        std::vector<T> values(dataset.getElementCount());
+        if (values.size()) {
+            dataset.read(values.data());
+        }
+        return values;
+    }
+
+    template <typename T, typename = std::enable_if_t<std::is_scalar_v<T>>>
+    void _read_scalar(T &value, std::string datapath) {
+        auto localpath = datapath;
+        regulerize_path(localpath);
+        auto values = _read_1D_array<T>(localpath + "scalar/0");
+        assert(values.size() == 1);
+        value = values[0];
+    }
+
+    template <typename T>
+    void _read_vector(std::vector<T> &vec, std::string datapath) {
+        auto localpath = datapath;
+        regulerize_path(localpath);
+        vec = _read_1D_array<T>(localpath + "vector/0");
+    }
+
+    template <int N, typename... Ts>
+    void _read_tuple(std::tuple<Ts...> &pack, std::string datapath) {
+        static_assert(N < sizeof...(Ts), "Out of bounds");
+        auto localpath = datapath;
+        regulerize_path(localpath);
+        read(std::get<N>(pack), localpath + "tuple/" + std::to_string(N));
+        if constexpr (N < sizeof...(Ts) - 1) {
+            _read_tuple<N + 1, Ts...>(pack, datapath);
+        }
+    }
+
+    template <typename T, typename U, bool is_directed>
+    void _read_csrlist(CSRList<T, U, std::bool_constant<is_directed>> &list,
+                       std::string datapath) {
+        auto localpath = datapath;
+        regulerize_path(localpath);
+        localpath += "csrlist/";
+        read(list.data(), localpath + "data");
+        read(list.offset(), localpath + "offset");
+    }
+
 private:
     std::unique_ptr<h5::File> _file;
+    StorageOptions _storage;
 };
 
 #endif // __HDF5FILE_H__
\ No newline at end of file
@@ -0,0 +1,59 @@
+#ifndef __MAPPED_FILE_H__
+#define __MAPPED_FILE_H__
+
+#include <cstddef>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Read-only memory mapping of a whole file. The mapping is released on
+ * destruction; good() is false if the file cannot be opened or is empty.
+ */
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &filename)
+        : _data(nullptr), _size(0) {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat status;
+        if (::fstat(fd, &status) == 0 and status.st_size > 0) {
+            auto size = static_cast<std::size_t>(status.st_size);
+            void *addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                ::madvise(addr, size, MADV_SEQUENTIAL);
+                _data = static_cast<const char *>(addr);
+                _size = size;
+            }
+        }
+        ::close(fd);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+        if (_data) {
+            ::munmap(const_cast<char *>(_data), _size);
+        }
+    }
+
+    bool good() const { return _data != nullptr; }
+
+    const char *begin() const { return _data; }
+
+    const char *end() const { return _data + _size; }
+
+    std::size_t size() const { return _size; }
+
+private:
+    const char *_data;
+    std::size_t _size;
+};
+
+#endif // __MAPPED_FILE_H__
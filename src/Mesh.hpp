@@ -6,21 +6,31 @@
 #include <iostream>
 #include <metis.h>
 #include <numeric>
+#include <type_traits>
 #include <vector>
 
 #include "MeshConnectivity.hpp"
 #include "MeshPartitioner.hpp"
 
-template <int D>
-struct Mesh : public MeshConnectivity<Mesh<D>>,
-              public MeshPartitioner<Mesh<D>> {
-    using MeshElementInfo =
-        std::pair<CSRList<std::size_t>, std::vector<std::size_t>>;
+/*
+ * @tparam D spatial dimension
+ * @tparam I index type of nodes and elements; a 32-bit type halves the
+ * memory of all connectivity for meshes with less than 2^32 entities
+ */
+template <int D, typename I = std::size_t>
+struct Mesh : public MeshConnectivity<Mesh<D, I>>,
+              public MeshPartitioner<Mesh<D, I>> {
+    static_assert(std::is_integral_v<I>, "I must be an integral type");
+
+    using index_type = I;
+    using MeshElementInfo = std::pair<CSRList<I>, std::vector<I>>;
     using FiniteElementType = typename ElementSpace<D>::Type;
 
     // using MeshConnectivity<Mesh<D>>::MeshConnectivity;
     // using MeshPartitioner<Mesh<D>>::MeshPartitioner;
-    Mesh() : MeshConnectivity<Mesh<D>>(*this), MeshPartitioner<Mesh<D>>(*this) {
+    Mesh()
+        : MeshConnectivity<Mesh<D, I>>(*this),
+          MeshPartitioner<Mesh<D, I>>(*this) {
         nodes().clear();
         type_offset().clear();
         ElementSpace<3> space;
@@ -41,11 +51,11 @@ struct Mesh : public MeshConnectivity<Mesh<D>>,
     MeshElementInfo elements(FiniteElementType type) const noexcept {
         auto [begin_index, end_index] = type_offset(type);
         const auto &[element_connectivity, element_ID] = elements();
-        CSRList<std::size_t> local_element_connectivity(
+        CSRList<I> local_element_connectivity(
             element_connectivity.begin() + begin_index,
             element_connectivity.begin() + end_index);
-        std::vector<std::size_t> local_element_ID(
-            element_ID.begin() + begin_index, element_ID.begin() + end_index);
+        std::vector<I> local_element_ID(element_ID.begin() + begin_index,
+                                        element_ID.begin() + end_index);
         return {local_element_connectivity, local_element_ID};
     }
 
@@ -96,11 +106,11 @@ struct Mesh : public MeshConnectivity<Mesh<D>>,
         }
 
         const auto &[element_connectivity, element_ID] = elements();
-        CSRList<std::size_t> local_element_connectivity(
+        CSRList<I> local_element_connectivity(
             element_connectivity.begin() + begin_index,
             element_connectivity.begin() + end_index);
-        std::vector<std::size_t> local_element_ID(
-            element_ID.begin() + begin_index, element_ID.begin() + end_index);
+        std::vector<I> local_element_ID(element_ID.begin() + begin_index,
+                                        element_ID.begin() + end_index);
         return {local_element_connectivity, local_element_ID};
         /*
                 std::for_each(element_types.begin(), element_types.end(),
@@ -131,7 +141,9 @@ struct Mesh : public MeshConnectivity<Mesh<D>>,
         return _element_type_offset;
     }
 
-    void init() { MeshConnectivity<Mesh<D>>::init(); }
+    void init(bool generate_subentities = false) {
+        MeshConnectivity<Mesh<D, I>>::init(generate_subentities);
+    }
 
 private:
 private:
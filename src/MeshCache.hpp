@@ -0,0 +1,464 @@
+#ifndef __MESH_CACHE_H__
+#define __MESH_CACHE_H__
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "CSRList.hpp"
+#include "CSRListView.hpp"
+#include "MappedFile.hpp"
+#include "Mesh.hpp"
+
+/*
+ * Binary snapshot of a Mesh, so that repeated runs on the same mesh skip
+ * parsing the mesh file. Layout (host byte order):
+ *
+ *   Header | Entry[num_entries] | payloads
+ *
+ * Every payload starts at a multiple of mesh_cache::alignment, so the arrays
+ * can be used in place once the file is mapped. The header records the
+ * hash_file() of the source mesh file and which of its tags the element IDs
+ * were read from; a snapshot whose hash or tags differ from the current read
+ * is stale.
+ */
+namespace mesh_cache {
+
+constexpr char magic[8] = {'P', 'T', 'M', 'E', 'S', 'H', 'C', '\0'};
+constexpr std::uint32_t version = 3;
+constexpr std::uint32_t byte_order = 0x01020304;
+constexpr std::size_t alignment = 64;
+
+enum class Kind : std::uint32_t {
+    Nodes,
+    TypeOffset,
+    ElementID,
+    Elements,
+    Entities,
+    Connectivity,
+    Adjacency
+};
+
+struct Header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint32_t dim;
+    std::uint32_t index_size;
+    std::uint32_t generate_subentities;
+    std::uint32_t num_entries;
+    // tags of the element IDs, the MeshIO::MshGenerator of the read
+    std::uint32_t element_ids;
+    std::uint32_t reserved;
+    std::uint64_t source_hash;
+};
+
+/*
+ * One array, or one CSR list when offset_count > 0. Positions are bytes
+ * from the beginning of the file.
+ */
+struct Entry {
+    Kind kind;
+    std::uint32_t dim0;
+    std::uint32_t dim1;
+    std::uint32_t reserved;
+    std::uint64_t data_position;
+    std::uint64_t data_count;
+    std::uint64_t offset_position;
+    std::uint64_t offset_count;
+};
+
+/*
+ * 64-bit hash of the file content, seeded with the file size. Every 8-byte
+ * word is mixed (multiply, rotate, multiply) before it is combined, so a
+ * change of any bit reaches all bits of the state, and the result gets a
+ * final avalanche (the MurmurHash3 finalizer). Returns 0 if the file cannot
+ * be read.
+ */
+inline std::uint64_t hash_file(const std::string &filename) {
+    MappedFile file(filename);
+    if (not file.good()) {
+        return 0;
+    }
+    constexpr std::uint64_t c1 = 0x87c37b91114253d5ull;
+    constexpr std::uint64_t c2 = 0x4cf5ad432745937full;
+    auto rotl = [](std::uint64_t x, int r) {
+        return (x << r) | (x >> (64 - r));
+    };
+    auto mix = [&](std::uint64_t h, std::uint64_t word) {
+        h ^= rotl(word * c1, 31) * c2;
+        return rotl(h, 27) * 5 + 0x52dce729;
+    };
+    std::uint64_t h = mix(0x9e3779b97f4a7c15ull, file.size());
+    const char *p = file.begin();
+    for (; file.end() - p >= 8; p += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        h = mix(h, word);
+    }
+    std::uint64_t tail = 0;
+    std::memcpy(&tail, p, file.end() - p);
+    h = mix(h, tail);
+    // avalanche
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+} // namespace mesh_cache
+
+/*
+ * Read-only view of a mapped snapshot. The views handed out point into the
+ * mapping and live as long as the MeshCache; load() copies them into a Mesh.
+ */
+template <int D, typename I = std::size_t> class MeshCache {
+public:
+    // offsets of the CSR lists, stored as they are in memory
+    using Offset = typename CSRList<I>::size_type;
+
+    /*
+     * Rows of a CSR list stored in the snapshot
+     */
+    struct Table {
+        CSRListView<Offset> offset;
+        CSRListView<I> data;
+
+        std::size_t size() const {
+            return offset.empty() ? 0 : offset.size() - 1;
+        }
+
+        CSRListView<I> operator[](std::size_t i) const {
+            return CSRListView<I>(data.data() + offset[i],
+                                  offset[i + 1] - offset[i]);
+        }
+
+        CSRList<I> to_list() const {
+            return CSRList<I>(data.to_vector(), offset.to_vector());
+        }
+    };
+
+    explicit MeshCache(const std::string &filename)
+        : _file(filename), _header(nullptr), _entries(nullptr) {
+        using namespace mesh_cache;
+        if (not _file.good() or _file.size() < sizeof(Header)) {
+            return;
+        }
+        const auto *header = reinterpret_cast<const Header *>(_file.begin());
+        if (std::memcmp(header->magic, magic, sizeof(magic)) != 0 or
+            header->version != version or header->byte_order != byte_order or
+            header->dim != D or header->index_size != sizeof(I) or
+            _file.size() <
+                sizeof(Header) + header->num_entries * sizeof(Entry)) {
+            return;
+        }
+        const auto *entries =
+            reinterpret_cast<const Entry *>(_file.begin() + sizeof(Header));
+        for (std::uint32_t i = 0; i < header->num_entries; ++i) {
+            const auto &entry = entries[i];
+            auto size = _element_size(entry.kind);
+            if (entry.data_position % alignment != 0 or
+                entry.offset_position % alignment != 0 or
+                entry.data_position + entry.data_count * size > _file.size() or
+                entry.offset_position + entry.offset_count * sizeof(Offset) >
+                    _file.size()) {
+                return;
+            }
+        }
+        _header = header;
+        _entries = entries;
+    }
+
+    MeshCache(const MeshCache &) = delete;
+    MeshCache &operator=(const MeshCache &) = delete;
+
+    /*
+     * The file is a snapshot of a Mesh<D, I> written by this version
+     */
+    bool good() const { return _header != nullptr; }
+
+    std::uint64_t source_hash() const {
+        return good() ? _header->source_hash : 0;
+    }
+
+    std::uint32_t element_ids() const {
+        return good() ? _header->element_ids : 0;
+    }
+
+    /*
+     * The snapshot was taken from the current content of the source file,
+     * with the element IDs read from the given tags
+     */
+    bool is_fresh(const std::string &source,
+                  std::uint32_t element_ids = 0) const {
+        return good() and _header->element_ids == element_ids and
+               _header->source_hash == mesh_cache::hash_file(source);
+    }
+
+    bool subentity_generation() const {
+        return good() and _header->generate_subentities != 0;
+    }
+
+    CSRListView<double> nodes() const {
+        return _array<double>(mesh_cache::Kind::Nodes);
+    }
+
+    CSRListView<std::uint64_t> type_offset() const {
+        return _array<std::uint64_t>(mesh_cache::Kind::TypeOffset);
+    }
+
+    CSRListView<I> element_ID() const {
+        return _array<I>(mesh_cache::Kind::ElementID);
+    }
+
+    Table elements() const { return _table(mesh_cache::Kind::Elements); }
+
+    bool has_entities(std::size_t dim) const {
+        return _find(mesh_cache::Kind::Entities, dim) != nullptr;
+    }
+
+    Table entities(std::size_t dim) const {
+        return _table(mesh_cache::Kind::Entities, dim);
+    }
+
+    bool has_connectivity(std::size_t dim0, std::size_t dim1) const {
+        return _find(mesh_cache::Kind::Connectivity, dim0, dim1) != nullptr;
+    }
+
+    Table connectivity(std::size_t dim0, std::size_t dim1) const {
+        return _table(mesh_cache::Kind::Connectivity, dim0, dim1);
+    }
+
+    bool has_adjacent_vertices() const {
+        return _find(mesh_cache::Kind::Adjacency) != nullptr;
+    }
+
+    Table adjacent_vertices() const {
+        return _table(mesh_cache::Kind::Adjacency);
+    }
+
+    /*
+     * Replaces the content of mesh by the snapshot. Cached entities,
+     * connectivity pairs and adjacency are installed as already built if
+     * they were taken with the subentity generation setting of mesh, which
+     * is kept; otherwise they are left to be built again.
+     * @return false if the snapshot is not good()
+     */
+    bool load(Mesh<D, I> &mesh) const {
+        if (not good()) {
+            return false;
+        }
+        mesh.release();
+        auto nodes = this->nodes();
+        mesh.nodes().assign(nodes.begin(), nodes.end());
+        auto type_offset = this->type_offset();
+        mesh.type_offset().assign(type_offset.begin(), type_offset.end());
+        auto &[element_info, element_ID] = mesh.elements();
+        element_info = elements().to_list();
+        element_ID = this->element_ID().to_vector();
+        if (mesh.subentity_generation() != subentity_generation()) {
+            return true;
+        }
+
+        for (std::size_t dim = 0; dim <= D; ++dim) {
+            if (has_entities(dim)) {
+                mesh.adopt_entities(dim, entities(dim).to_list());
+            }
+        }
+        for (std::size_t dim0 = 0; dim0 <= D; ++dim0) {
+            for (std::size_t dim1 = 0; dim1 <= D; ++dim1) {
+                if (has_connectivity(dim0, dim1)) {
+                    mesh.adopt(dim0, dim1,
+                               connectivity(dim0, dim1).to_list());
+                }
+            }
+        }
+        if (has_adjacent_vertices()) {
+            mesh.adopt_adjacent_vertices(adjacent_vertices().to_list());
+        }
+        return true;
+    }
+
+    /*
+     * Writes a snapshot of mesh to filename.
+     * @param source_hash mesh_cache::hash_file() of the source mesh file
+     * @param with_connectivity also store the entity collections,
+     * connectivity pairs and adjacency built so far (nothing is built here)
+     * @param element_ids tags of the source the element IDs were read from
+     * @return false if the file cannot be written
+     */
+    static bool write(const Mesh<D, I> &mesh, const std::string &filename,
+                      std::uint64_t source_hash, bool with_connectivity = true,
+                      std::uint32_t element_ids = 0) {
+        using namespace mesh_cache;
+        std::vector<Entry> entries;
+        std::vector<std::pair<const void *, const void *>> payloads;
+        auto add = [&](Kind kind, std::size_t dim0, std::size_t dim1,
+                       const void *data, std::size_t data_count,
+                       const void *offset, std::size_t offset_count) {
+            Entry entry{kind, static_cast<std::uint32_t>(dim0),
+                        static_cast<std::uint32_t>(dim1),
+                        0,
+                        0,
+                        data_count,
+                        0,
+                        offset_count};
+            entries.push_back(entry);
+            payloads.emplace_back(data, offset);
+        };
+        auto add_list = [&](Kind kind, std::size_t dim0, std::size_t dim1,
+                            const CSRList<I> &list) {
+            add(kind, dim0, dim1, list.data().data(), list.data().size(),
+                list.offset().data(), list.offset().size());
+        };
+
+        std::vector<std::uint64_t> type_offset(mesh.type_offset().begin(),
+                                               mesh.type_offset().end());
+        const auto &[element_info, element_ID] = mesh.elements();
+        add(Kind::Nodes, 0, 0, mesh.nodes().data(), mesh.nodes().size(),
+            nullptr, 0);
+        add(Kind::TypeOffset, 0, 0, type_offset.data(), type_offset.size(),
+            nullptr, 0);
+        add(Kind::ElementID, 0, 0, element_ID.data(), element_ID.size(),
+            nullptr, 0);
+        add_list(Kind::Elements, 0, 0, element_info);
+        if (with_connectivity) {
+            for (std::size_t dim = 0; dim <= D; ++dim) {
+                if (mesh.is_collected(dim)) {
+                    add_list(Kind::Entities, dim, 0,
+                             mesh.element_collections(dim));
+                }
+            }
+            for (std::size_t dim0 = 0; dim0 <= D; ++dim0) {
+                for (std::size_t dim1 = 0; dim1 <= D; ++dim1) {
+                    if (mesh.is_built(dim0, dim1)) {
+                        add_list(Kind::Connectivity, dim0, dim1,
+                                 mesh.connectivity(dim0, dim1));
+                    }
+                }
+            }
+            if (mesh.is_adjacency_built()) {
+                add_list(Kind::Adjacency, 0, 0, mesh.adjacent_vertices());
+            }
+        }
+
+        // lay out the payloads after the entry table
+        std::uint64_t position = _align(sizeof(Header) +
+                                        entries.size() * sizeof(Entry));
+        for (auto &entry : entries) {
+            entry.data_position = position;
+            position = _align(position +
+                              entry.data_count * _element_size(entry.kind));
+            entry.offset_position = position;
+            position =
+                _align(position + entry.offset_count * sizeof(Offset));
+        }
+
+        Header header;
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version = version;
+        header.byte_order = byte_order;
+        header.dim = D;
+        header.index_size = sizeof(I);
+        header.generate_subentities = mesh.subentity_generation() ? 1 : 0;
+        header.num_entries = static_cast<std::uint32_t>(entries.size());
+        header.element_ids = element_ids;
+        header.reserved = 0;
+        header.source_hash = source_hash;
+
+        std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+        if (not file) {
+            return false;
+        }
+        std::uint64_t written = 0;
+        auto put = [&](const void *bytes, std::size_t size) {
+            file.write(static_cast<const char *>(bytes), size);
+            written += size;
+        };
+        auto pad_to = [&](std::uint64_t target) {
+            static const char zeros[alignment] = {};
+            put(zeros, target - written);
+        };
+        put(&header, sizeof(header));
+        put(entries.data(), entries.size() * sizeof(Entry));
+        for (std::size_t i = 0; i < entries.size(); ++i) {
+            const auto &entry = entries[i];
+            pad_to(entry.data_position);
+            put(payloads[i].first,
+                entry.data_count * _element_size(entry.kind));
+            pad_to(entry.offset_position);
+            put(payloads[i].second, entry.offset_count * sizeof(Offset));
+        }
+        pad_to(position);
+        return static_cast<bool>(file);
+    }
+
+private:
+    static std::uint64_t _align(std::uint64_t position) {
+        return (position + mesh_cache::alignment - 1) /
+               mesh_cache::alignment * mesh_cache::alignment;
+    }
+
+    static std::size_t _element_size(mesh_cache::Kind kind) {
+        switch (kind) {
+        case mesh_cache::Kind::Nodes:
+            return sizeof(double);
+        case mesh_cache::Kind::TypeOffset:
+            return sizeof(std::uint64_t);
+        default:
+            return sizeof(I);
+        }
+    }
+
+    const mesh_cache::Entry *_find(mesh_cache::Kind kind,
+                                   std::size_t dim0 = 0,
+                                   std::size_t dim1 = 0) const {
+        if (not good()) {
+            return nullptr;
+        }
+        for (std::uint32_t i = 0; i < _header->num_entries; ++i) {
+            const auto &entry = _entries[i];
+            if (entry.kind == kind and entry.dim0 == dim0 and
+                entry.dim1 == dim1) {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    template <typename T>
+    CSRListView<T> _array(mesh_cache::Kind kind) const {
+        const auto *entry = _find(kind);
+        if (entry == nullptr) {
+            return CSRListView<T>();
+        }
+        return CSRListView<T>(
+            reinterpret_cast<const T *>(_file.begin() + entry->data_position),
+            entry->data_count);
+    }
+
+    Table _table(mesh_cache::Kind kind, std::size_t dim0 = 0,
+                 std::size_t dim1 = 0) const {
+        const auto *entry = _find(kind, dim0, dim1);
+        if (entry == nullptr) {
+            return Table();
+        }
+        return Table{
+            CSRListView<Offset>(reinterpret_cast<const Offset *>(
+                                    _file.begin() + entry->offset_position),
+                                entry->offset_count),
+            CSRListView<I>(reinterpret_cast<const I *>(_file.begin() +
+                                                       entry->data_position),
+                           entry->data_count)};
+    }
+
+    MappedFile _file;
+    const mesh_cache::Header *_header;
+    const mesh_cache::Entry *_entries;
+};
+
+#endif // __MESH_CACHE_H__
@@ -1,188 +1,550 @@
 #ifndef __MESH_CONNECTIVITY_H__
 #define __MESH_CONNECTIVITY_H__
 
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cassert>
+#include <mutex>
+#include <numeric>
+#include <optional>
+
 #include "CSRList.hpp"
+#include "ElementSpace.hpp"
+#include "SubentityTable.hpp"
 
 template <typename Derived> struct MeshConnectivity {};
 
-template <template <int> typename DerivedClass, int D>
-struct MeshConnectivity<DerivedClass<D>> {
+template <template <int, typename> typename DerivedClass, int D, typename I>
+struct MeshConnectivity<DerivedClass<D, I>> {
 
-    using Derived = DerivedClass<D>;
+    using Derived = DerivedClass<D, I>;
     MeshConnectivity(const Derived &mesh)
-        : _mesh(&mesh), _element_aggregations(D + 1) {}
+        : _element_aggregations(D + 1), _collected(D + 1, false),
+          _mesh(&mesh), _generate(false), _adjacency_built(false),
+          _orientation_built(false),
+          _num_threads(parallel::default_num_threads()) {}
 
-    void init() {
-        for (std::size_t i = 0; i <= D; ++i) {
-            _collect_mesh_entities(i);
-        }
+    /*
+     * Eagerly builds every connectivity pair, the vertex adjacency and the
+     * facet orientations. All of them are otherwise built on first request.
+     * @param generate_subentities enumerate every facet (and every edge for
+     * D == 3) of the prime elements instead of only using the ones present in
+     * the mesh file, see _generate_subentities()
+     */
+    void init(bool generate_subentities = false) {
+        enable_subentity_generation(generate_subentities);
+        std::lock_guard<std::mutex> lock(_mutex);
         _build_all_connectivity();
         _build_vertex_adjacency_list();
         _build_orientation_of_subentities();
     }
 
-    const CSRList<std::size_t> &connectivity(std::size_t dim0,
-                                             std::size_t dim1) const {
-        return _connectivity.at({dim0, dim1});
+    /*
+     * Switches the facets/edges between the ones read from the mesh file and
+     * the generated ones. Everything cached so far is released.
+     */
+    void enable_subentity_generation(bool enable = true) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_generate != enable) {
+            _release_all();
+            _generate = enable;
+        }
     }
 
-    const CSRList<std::size_t> &adjacent_vertices() const {
+    /*
+     * {dim0, dim1}: the dim1 entities related to each dim0 entity. Built and
+     * cached on the first request together with the pairs it depends on.
+     */
+    const CSRList<I> &connectivity(std::size_t dim0, std::size_t dim1) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _pair(dim0, dim1);
+    }
+
+    const CSRList<I> &adjacent_vertices() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _build_vertex_adjacency_list();
         return _adjacent_vertices;
     }
 
-    const CSRList<std::size_t> &element_collections(int dim) const {
-        return this->_element_aggregations[dim];
+    const CSRList<I> &element_collections(int dim) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _entities(dim);
     }
 
-    const CSRList<std::size_t> &orientation() const {
+    const CSRList<I> &orientation() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _build_orientation_of_subentities();
         return this->_orientation;
     }
 
+    /*
+     * Bit dim0 * (D + 1) + dim1 is set when {dim0, dim1} is cached. Querying
+     * never triggers a construction.
+     */
+    using BuiltMask = std::bitset<(D + 1) * (D + 1)>;
+
+    BuiltMask built_mask() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _built;
+    }
+
+    bool is_built(std::size_t dim0, std::size_t dim1) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _built[_slot(dim0, dim1)];
+    }
+
+    /*
+     * Bytes held by the cached pairs, entity collections, adjacency and
+     * orientations (allocated capacity, not the logical size).
+     */
+    std::size_t memory_footprint() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::size_t bytes = _bytes(_adjacent_vertices) + _bytes(_orientation);
+        for (const auto &entities : _element_aggregations) {
+            bytes += _bytes(entities);
+        }
+        for (const auto &pair : _connectivity) {
+            bytes += pair ? _bytes(*pair) : 0;
+        }
+        return bytes;
+    }
+
+    std::size_t memory_footprint(std::size_t dim0, std::size_t dim1) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const auto &pair = _connectivity[_slot(dim0, dim1)];
+        return pair ? _bytes(*pair) : 0;
+    }
+
+    /*
+     * Drops the cached {dim0, dim1}; it is rebuilt if requested again, the
+     * generated {D, D - 1} and {D, 1} in local subentity order. References
+     * previously returned by connectivity(dim0, dim1) dangle.
+     */
+    void release(std::size_t dim0, std::size_t dim1) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _drop(dim0, dim1);
+        if (dim0 == D - 1 and dim1 == D) {
+            _release_orientation();
+        }
+    }
+
+    void release_adjacent_vertices() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _adjacent_vertices.clear();
+        _adjacency_built = false;
+    }
+
+    /*
+     * Drops every cached pair, the adjacency, the orientations and the entity
+     * collections.
+     */
+    void release() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _release_all();
+    }
+
+    /*
+     * Snapshot support, see MeshCache: the state below can be saved and the
+     * adopt_* functions install lists computed by an earlier run in place of
+     * building them. Adopted lists must match the current subentity
+     * generation setting.
+     */
+    bool subentity_generation() const { return _generate; }
+
+    bool is_collected(std::size_t dim) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _collected[dim];
+    }
+
+    bool is_adjacency_built() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _adjacency_built;
+    }
+
+    void adopt_entities(std::size_t dim, CSRList<I> &&entities) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _element_aggregations[dim] = std::move(entities);
+        _collected[dim] = true;
+    }
+
+    void adopt(std::size_t dim0, std::size_t dim1, CSRList<I> &&list) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _store(dim0, dim1, std::move(list));
+    }
+
+    void adopt_adjacent_vertices(CSRList<I> &&adjacent_vertices) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _adjacent_vertices = std::move(adjacent_vertices);
+        _adjacency_built = true;
+    }
+
+    std::size_t num_threads() const { return _num_threads; }
+
+    void set_num_threads(std::size_t num_threads) {
+        _num_threads = std::max<std::size_t>(1, num_threads);
+    }
+
 private:
-    void _collect_mesh_entities(std::size_t dim) {
-        /*
-    const auto prime_element_type = ElementSpace<D>().prime_element_types();
-    auto num_prime_elements = std::accumulate(prime_element_type.begin(),
-    prime_element_type.end(),
-    static_cast<std::size_t>(0),
-    [this](std::size_t init, decltype(*prime_element_type.begin()) type) {
-        return init + _mesh->elements(type).second.size();
-    });
-    const auto secondary_element_type =
-    ElementSpace<D>().secondary_element_types(); auto num_secondary_elements =
-    std::accumulate(secondary_element_type.begin(),
-    secondary_element_type.end(),
-    static_cast<std::size_t>(0),
-    [this](std::size_t init, decltype(*prime_element_type.begin()) type) {
-        return init + _mesh->elements(type).second.size();
-    });
-    auto num_vertices = _mesh->nodes().size() / D;
-    const auto & element_types = ElementSpace<D>().all_element_types();
-    if(0 <= dim and dim <= D){
-    std::for_each(element_types.begin(), element_types.end(),
-        [dim, this](FiniteElementType type) {
-            auto topologic_dim = ElementSpace<D>().topologic_dim(type);
-            if(topologic_dim == dim) {
-                this->_element_aggregations[dim] +=
-    std::move(this->_mesh->elements(type).first);
+    static std::size_t _slot(std::size_t dim0, std::size_t dim1) {
+        assert(dim0 <= D and dim1 <= D);
+        return dim0 * (D + 1) + dim1;
+    }
+
+    static std::size_t _bytes(const CSRList<I> &list) {
+        return list.data().capacity() * sizeof(I) +
+               list.offset().capacity() *
+                   sizeof(typename CSRList<I>::size_type);
+    }
+
+    void _store(std::size_t dim0, std::size_t dim1, CSRList<I> &&list) const {
+        _connectivity[_slot(dim0, dim1)] = std::move(list);
+        _built.set(_slot(dim0, dim1));
+    }
+
+    void _drop(std::size_t dim0, std::size_t dim1) {
+        _connectivity[_slot(dim0, dim1)].reset();
+        _built.reset(_slot(dim0, dim1));
+    }
+
+    void _release_orientation() const {
+        _orientation.clear();
+        _orientation_built = false;
+    }
+
+    void _release_all() {
+        for (std::size_t i = 0; i <= D; ++i) {
+            for (std::size_t j = 0; j <= D; ++j) {
+                _drop(i, j);
             }
-        });
+        }
+        _adjacent_vertices.clear();
+        _adjacency_built = false;
+        _release_orientation();
+        for (std::size_t i = 0; i <= D; ++i) {
+            _element_aggregations[i].clear();
+            _collected[i] = false;
+        }
     }
-        */
+
+    void _collect_mesh_entities(std::size_t dim) const {
         this->_element_aggregations[dim] = this->_mesh->elements(dim).first;
+        _collected[dim] = true;
     }
 
-    // {dim0, dim1} already exists, now construct the reverse mappping {dim1,
-    // dim0}
-    void _construct_reverse_map(std::size_t dim0, std::size_t dim1) {
-        auto size0 = this->_connectivity[{dim0, dim1}].size();
-        auto size1 = this->_connectivity[{dim1, dim0}].size();
-        if (size0 > 0 and size1 == 0) {
-            this->_connectivity[{dim1, dim0}] =
-                this->_connectivity[{dim0, dim1}].reverse();
-            auto max_begin = this->_connectivity[{dim1, dim0}].size();
-            auto max_end = this->_element_aggregations[dim1].size();
-            for (std::size_t i = max_begin; i < max_end; ++i) {
-                this->_connectivity[{dim1, dim0}].push_back(
-                    std::vector<std::size_t>());
+    /*
+     * The entities of dimension dim. With subentity generation enabled,
+     * requesting the facets (or the edges for D == 3) enumerates them and
+     * fills {D, dim} as a side effect.
+     */
+    const CSRList<I> &_entities(std::size_t dim) const {
+        if (not _collected[dim]) {
+            _collect_mesh_entities(dim);
+            if (_is_generated(dim)) {
+                if (not _collected[D]) {
+                    _collect_mesh_entities(D);
+                }
+                _generate_subentities(dim);
             }
         }
+        return this->_element_aggregations[dim];
+    }
+
+    bool _is_generated(std::size_t dim) const {
+        return _generate and D >= 2 and
+               (dim + 1 == D or (D == 3 and dim == 1));
+    }
+
+    const CSRList<I> &_pair(std::size_t dim0, std::size_t dim1) const {
+        _build_connectivity_pair(dim0, dim1);
+        return *_connectivity[_slot(dim0, dim1)];
+    }
+
+    /*
+     * Reverse of {dim1, dim0}, padded with empty rows to the number of dim0
+     * entities. Stays empty when {dim1, dim0} is empty.
+     */
+    CSRList<I> _reverse_of(std::size_t dim1, std::size_t dim0) const {
+        const auto &source = _pair(dim1, dim0);
+        if (source.size() == 0) {
+            return CSRList<I>();
+        }
+        auto results = source.reverse(_num_threads);
+        auto num_entities = _entities(dim0).size();
+        for (std::size_t i = results.size(); i < num_entities; ++i) {
+            results.push_back(std::vector<I>());
+        }
+        return results;
     }
 
-    void _build_connectivity_pair(std::size_t dim0, std::size_t dim1,
-                                  int depth) {
+    /*
+     * Builds {dim0, dim1} if it is not cached yet: {dim, 0} is the entity
+     * list itself, {0, dim} and {dim0, dim1} with dim0 > dim1 are reverses,
+     * and {dim0, dim1} with 0 < dim0 < dim1 intersects the vertex-to-dim1
+     * rows. Self pairs are empty.
+     */
+    void _build_connectivity_pair(std::size_t dim0, std::size_t dim1) const {
+        if (_built[_slot(dim0, dim1)]) {
+            return;
+        }
+        const auto &entities = _entities(dim0);
+        _entities(dim1);
+        // generated subentities come with {D, D - 1} and {D, 1}
+        if (_built[_slot(dim0, dim1)]) {
+            return;
+        }
+        if (dim0 == D and _is_generated(dim1)) {
+            // released since the enumeration: enumerate again to restore the
+            // local order, every subentity is found under its index
+            _generate_subentities(dim1);
+            return;
+        }
 
-        auto size0 = this->_connectivity[{dim0, dim1}].size();
-        // auto size1 = this->_connectivity[{dim1, dim0}].size();
-        if (dim0 == dim1     // Connectivity to self alwasy exsits
-            or size0 != 0) { // Connectivity has been constructed
-                             // return;
-        } else if (dim0 == 0 or dim1 == 0) {
-            // if {dim0+dim1, 0} is empty, then construct it
-            if (this->_connectivity[{dim0 + dim1, 0}].size() == 0) {
-                this->_connectivity[{dim0 + dim1, 0}] =
-                    this->_element_aggregations[dim1 + dim0];
+        CSRList<I> results;
+        if (dim0 == dim1) {
+            // connectivity to self is implicit
+        } else if (dim1 == 0) {
+            results = entities;
+        } else if (dim0 == 0) {
+            results = _reverse_of(dim1, dim0);
+        } else if (dim0 > dim1 or _built[_slot(dim1, dim0)]) {
+            // the transpose is already known, e.g. generated subentities
+            results = _reverse_of(dim1, dim0);
+        } else {
+            const auto &entity_vertex_to_dim1 = _pair(0, dim1);
+            if (entities.size() != 0 and entity_vertex_to_dim1.size() != 0) {
+                // {dim0, dim1}: the dim1 entities shared by all vertices of
+                // a dim0 entity. Count them per entity, scan, then fill the
+                // pre-sized CSR; both passes run in parallel over entities.
+                const std::size_t num_entities = entities.size();
+                auto &offset = results.offset();
+                offset.assign(num_entities + 1, 0);
+                parallel::for_each_chunk(
+                    num_entities, _num_threads,
+                    [&](std::size_t begin, std::size_t end, std::size_t) {
+                        for (auto i = begin; i < end; ++i) {
+                            I count = 0;
+                            _for_each_common_entity(
+                                entities[i], entity_vertex_to_dim1,
+                                [&](I) { ++count; });
+                            offset[i + 1] = count;
+                        }
+                    });
+                std::partial_sum(offset.begin(), offset.end(), offset.begin());
+
+                auto &data = results.data();
+                data.resize(offset.back());
+                parallel::for_each_chunk(
+                    num_entities, _num_threads,
+                    [&](std::size_t begin, std::size_t end, std::size_t) {
+                        for (auto i = begin; i < end; ++i) {
+                            auto position = offset[i];
+                            _for_each_common_entity(
+                                entities[i], entity_vertex_to_dim1,
+                                [&](I ientity) { data[position++] = ientity; });
+                        }
+                    });
             }
-            // when (0 == dim0), construct {0, dim1}
-            // reverse the CSRList and fill to # of elements
-            if (dim0 < dim1) {
-                _construct_reverse_map(dim1, dim0);
+        }
+        _store(dim0, dim1, std::move(results));
+    }
+
+    /*
+     * Calls visit(e), in ascending order, for every entity e that appears in
+     * vertex_to_entity[v] for all v in vertices, i.e. a k-way intersection of
+     * the rows: the shortest row is scanned and every candidate is looked up
+     * in the others by binary search. The rows of vertex_to_entity must be
+     * sorted, which holds for lists produced by CSRList::reverse.
+     */
+    template <typename Row, typename Visit>
+    static void _for_each_common_entity(const Row &vertices,
+                                        const CSRList<I> &vertex_to_entity,
+                                        Visit &&visit) {
+        if (vertices.empty()) {
+            return;
+        }
+        auto shortest = vertex_to_entity[vertices[0]];
+        for (auto ivtx : vertices) {
+            auto row = vertex_to_entity[ivtx];
+            if (row.size() < shortest.size()) {
+                shortest = row;
             }
-        } else if (dim0 > dim1) {
-            _build_connectivity_pair(dim1, dim0, depth + 1);
-            _construct_reverse_map(dim1, dim0);
-        } else {
-            _build_connectivity_pair(dim0, 0, depth + 1);
-            _build_connectivity_pair(0, dim1, depth + 1);
-            const auto &entity_dim0_to_vertex = this->_connectivity[{dim0, 0}];
-            const auto &entity_vertex_to_dim1 = this->_connectivity[{0, dim1}];
-            if (entity_dim0_to_vertex.size() != 0 and
-                entity_vertex_to_dim1.size() != 0) {
-                for (auto dim0_to_vertex_list : entity_dim0_to_vertex) {
-                    // Find: who appears n times, where n is number of vertices
-                    // in the entity;
-                    std::map<std::size_t, std::size_t> counter;
-                    for (const auto ivtx : dim0_to_vertex_list.data()) {
-                        for (const auto &ientity :
-                             entity_vertex_to_dim1[ivtx]) {
-                            counter[ientity]++;
+        }
+        for (auto candidate : shortest) {
+            auto is_common = std::all_of(
+                vertices.begin(), vertices.end(), [&](I ivtx) {
+                    auto row = vertex_to_entity[ivtx];
+                    return std::binary_search(row.begin(), row.end(),
+                                              candidate);
+                });
+            if (is_common) {
+                visit(candidate);
+            }
+        }
+    }
+
+    /*
+     * Generates all facets (and edges for D == 3) of the prime elements in a
+     * single pass over the cells, using the local face tables of
+     * ElementNumbering. Facets/edges read from the mesh file keep their
+     * indices; the missing ones are appended. Fills {D, D - 1} or {D, 1}
+     * with the subentities of each cell in local order; the remaining pairs
+     * follow from _build_connectivity_pair().
+     */
+    void _generate_subentities(std::size_t dim) const {
+        if constexpr (D >= 2) {
+            if (dim + 1 != D) {
+                // edges of a 3D mesh
+            } else {
+                _enumerate_subentities(D - 1, [](FiniteElementType type) {
+                    std::vector<std::vector<std::size_t>> local;
+                    for (std::size_t i = 0;; ++i) {
+                        auto facet =
+                            ElementNumbering::subentity_indices(type, i);
+                        if (facet.size() < (D == 2 ? 2 : 3)) {
+                            break;
                         }
+                        local.push_back(std::move(facet));
                     }
+                    return local;
+                });
+                return;
+            }
+        }
+        if constexpr (D == 3) {
+            _enumerate_subentities(1, [](FiniteElementType type) {
+                std::vector<std::vector<std::size_t>> local;
+                for (auto edge : ElementNumbering::edge_indices(type)) {
+                    local.push_back({edge[0], edge[1]});
+                }
+                return local;
+            });
+        }
+    }
+
+    template <typename LocalTable>
+    void _enumerate_subentities(std::size_t dim,
+                                const LocalTable &local_table) const {
+        const auto &cells = _element_aggregations[D];
+        auto &entities = _element_aggregations[dim];
 
-                    std::vector<std::size_t> connected_entities;
-                    std::for_each(counter.begin(), counter.end(),
-                                  [&](decltype(counter)::value_type &pair) {
-                                      if (pair.second ==
-                                          dim0_to_vertex_list.data().size()) {
-                                          connected_entities.push_back(
-                                              pair.first);
-                                      }
-                                  });
-                    this->_connectivity[{dim0, dim1}].push_back(
-                        std::move(connected_entities));
+        // local subentities of each cell type, indexed by FiniteElementType
+        std::vector<std::vector<std::vector<std::size_t>>> local_subentities;
+        for (auto type : ElementSpace<D>::all_element_types()) {
+            local_subentities.resize(static_cast<std::size_t>(type) + 1);
+            local_subentities[static_cast<std::size_t>(type)] =
+                local_table(type);
+        }
+        auto local_subentities_of = [&](std::size_t num_vertices)
+            -> const std::vector<std::vector<std::size_t>> & {
+            auto type = static_cast<std::size_t>(
+                ElementSpace<D>::element_type(num_vertices));
+            static const std::vector<std::vector<std::size_t>> none;
+            return type < local_subentities.size() ? local_subentities[type]
+                                                   : none;
+        };
+
+        CSRList<I> cell_to_entity;
+        auto &offset = cell_to_entity.offset();
+        offset.resize(cells.size() + 1);
+        for (std::size_t i = 0; i < cells.size(); ++i) {
+            offset[i + 1] =
+                offset[i] + local_subentities_of(cells[i].size()).size();
+        }
+        auto &data = cell_to_entity.data();
+        data.resize(offset.back());
+
+        SubentityTable<I> table(entities.size() + data.size());
+        for (std::size_t i = 0; i < entities.size(); ++i) {
+            table.insert(entities[i], static_cast<I>(i));
+        }
+        std::array<I, 4> vertices;
+        auto position = data.begin();
+        for (auto cell : cells) {
+            for (const auto &local : local_subentities_of(cell.size())) {
+                for (std::size_t k = 0; k < local.size(); ++k) {
+                    vertices[k] = cell[local[k]];
+                }
+                CSRListView<I> subentity(vertices.data(), local.size());
+                auto [index, inserted] =
+                    table.insert(subentity, static_cast<I>(entities.size()));
+                if (inserted) {
+                    entities.push_back(subentity);
                 }
+                *position++ = index;
             }
         }
+        _store(D, dim, std::move(cell_to_entity));
     }
 
-    void _build_all_connectivity() {
+    void _build_all_connectivity() const {
         for (std::size_t i = 0; i <= D; ++i) {
             for (std::size_t j = 0; j <= D; ++j) {
-                _build_connectivity_pair(j, i, 0);
+                _build_connectivity_pair(j, i);
             }
         }
     }
 
-    void _build_vertex_adjacency_list() {
-        const auto prime_element_list = _element_aggregations[D];
-        auto nnode = _mesh->nodes().size() / D;
-        std::size_t expected_bandwidth = 64;
-        std::vector<std::vector<std::size_t>> adjacency(nnode);
-        for (auto &cache : adjacency) {
-            cache.reserve(expected_bandwidth);
+    /*
+     * Row v holds, sorted and unique, every vertex sharing a prime element
+     * with v (v included). Rows are gathered through the vertex-to-cell map:
+     * each thread merges the cells of its block of vertices into a private
+     * buffer while recording the row sizes, then the sizes are scanned and
+     * the buffers copied into place, again in parallel.
+     */
+    void _build_vertex_adjacency_list() const {
+        if (_adjacency_built) {
+            return;
         }
-
-        for (auto cell : prime_element_list) {
-            const auto &vertex_list = cell.data();
-            std::for_each(vertex_list.begin(), vertex_list.end(),
-                          [&](std::size_t ivtx) {
-                              adjacency[ivtx].insert(adjacency[ivtx].end(),
-                                                     vertex_list.begin(),
-                                                     vertex_list.end());
-                          });
+        _adjacency_built = true;
+        const auto &prime_element_list = _entities(D);
+        const std::size_t nnode = _mesh->nodes().size() / D;
+        CSRList<I> reversed;
+        if (not _built[_slot(0, D)]) {
+            reversed = prime_element_list.reverse(_num_threads);
         }
+        const auto &vertex_to_cell =
+            _built[_slot(0, D)] ? *_connectivity[_slot(0, D)] : reversed;
+        const std::size_t num_rows =
+            std::min<std::size_t>(nnode, vertex_to_cell.size());
 
-        for (auto &cache : adjacency) {
-            // remove duplicated entries
-            std::sort(cache.begin(), cache.end());
-            cache.erase(std::unique(cache.begin(), cache.end()), cache.end());
-            this->_adjacent_vertices.push_back(std::move(cache));
-        }
+        CSRList<I> adjacency;
+        auto &offset = adjacency.offset();
+        offset.assign(nnode + 1, 0);
+        std::vector<std::vector<I>> buffers(
+            std::max<std::size_t>(1, std::min(_num_threads, num_rows)));
+        auto num_chunks = parallel::for_each_chunk(
+            num_rows, _num_threads,
+            [&](std::size_t begin, std::size_t end, std::size_t t) {
+                auto &buffer = buffers[t];
+                for (auto ivtx = begin; ivtx < end; ++ivtx) {
+                    auto row_begin = buffer.size();
+                    for (auto icell : vertex_to_cell[ivtx]) {
+                        auto cell = prime_element_list[icell];
+                        buffer.insert(buffer.end(), cell.begin(), cell.end());
+                    }
+                    auto row = buffer.begin() + row_begin;
+                    std::sort(row, buffer.end());
+                    buffer.erase(std::unique(row, buffer.end()), buffer.end());
+                    offset[ivtx + 1] = buffer.size() - row_begin;
+                }
+            });
+        std::partial_sum(offset.begin(), offset.end(), offset.begin());
+
+        auto &data = adjacency.data();
+        data.resize(offset.back());
+        parallel::for_each_chunk(
+            num_rows, num_chunks,
+            [&](std::size_t begin, std::size_t, std::size_t t) {
+                std::copy(buffers[t].begin(), buffers[t].end(),
+                          data.begin() + offset[begin]);
+            });
+        this->_adjacent_vertices = std::move(adjacency);
     }
 
+    template <typename Child, typename Parent>
     static std::vector<std::size_t>
-    _get_child_indices_in_parent(const std::vector<std::size_t> &child,
-                                 const std::vector<std::size_t> &parent) {
+    _get_child_indices_in_parent(const Child &child, const Parent &parent) {
         std::vector<std::size_t> indices;
         indices.reserve(child.size());
         for (std::size_t i = 0;
@@ -198,17 +560,21 @@ private:
                                                : std::vector<std::size_t>());
     }
 
-    void _build_orientation_of_subentities() {
-        const auto &prime_element_list = element_collections(D);
-        const auto &secondary_element_list = element_collections(D - 1);
-        const auto &subentity_to_entity = connectivity(D - 1, D);
+    void _build_orientation_of_subentities() const {
+        if (_orientation_built) {
+            return;
+        }
+        _orientation_built = true;
+        const auto &prime_element_list = _entities(D);
+        const auto &secondary_element_list = _entities(D - 1);
+        const auto &subentity_to_entity = _pair(D - 1, D);
         for (std::size_t i = 0; i < subentity_to_entity.size(); ++i) {
             auto subentity_global_indices = secondary_element_list[i];
             auto base_entity_ID = subentity_to_entity[i];
-            std::vector<std::size_t> subentity_orientation;
+            std::vector<I> subentity_orientation;
             subentity_orientation.reserve(1);
             for (auto idx : base_entity_ID) {
-                const auto &base_entity_global_list = prime_element_list[idx];
+                auto base_entity_global_list = prime_element_list[idx];
                 const auto &subentity_local_indices =
                     _get_child_indices_in_parent(subentity_global_indices,
                                                  base_entity_global_list);
@@ -227,17 +593,20 @@ private:
 
 private:
 public:
-    std::vector<CSRList<std::size_t>> _element_aggregations;
-    using Key = std::array<std::size_t, 2>;
-    struct Cmp {
-        bool operator()(const Key &first, const Key &second) const {
-            return first[0] * 10 + first[1] < second[0] * 10 + second[1];
-        }
-    };
-    std::map<Key, CSRList<std::size_t>, Cmp> _connectivity;
-    CSRList<std::size_t> _adjacent_vertices;
-    CSRList<std::size_t> _orientation;
+    mutable std::vector<CSRList<I>> _element_aggregations;
+    mutable std::vector<bool> _collected;
+    // {dim0, dim1} at dim0 * (D + 1) + dim1; _built mirrors has_value()
+    mutable std::array<std::optional<CSRList<I>>, (D + 1) * (D + 1)>
+        _connectivity;
+    mutable BuiltMask _built;
+    mutable CSRList<I> _adjacent_vertices;
+    mutable CSRList<I> _orientation;
     const Derived *_mesh;
+    bool _generate;
+    mutable bool _adjacency_built;
+    mutable bool _orientation_built;
+    mutable std::mutex _mutex;
+    std::size_t _num_threads;
 };
 
 #endif // __MESH_CONNECTIVITY_H__
@@ -1,239 +1,1360 @@
 #ifndef __MESH_IO_H__
 #define __MESH_IO_H__
-#include <fstream>
+#include <cctype>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
-#include <map>
+#include <limits>
 #include <numeric>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 // #include <highfive/H5File.hpp>
 #include "HDF5File.hpp"
+#include "MappedFile.hpp"
+#include "MeshCache.hpp"
 #include "Mesh.hpp"
+#include "Parallel.hpp"
 
 struct MeshIO {
 
     enum class MshGenerator : int { GMSH = 0, ANSA = 1 };
 
-    template <int D>
-    static int read(Mesh<D> &mesh, const std::string &filename,
+    template <int D, typename I>
+    static int read(Mesh<D, I> &mesh, const std::string &filename,
                     MshGenerator type = MshGenerator::GMSH) {
         // get the extension
         auto ext = filename.substr(filename.find_last_of('.') + 1);
         if (ext == "msh" or ext == "gmsh") {
             return _read_gmsh(mesh, filename, type);
         }
+        if (ext == "h5" or ext == "hdf5") {
+            return _read_h5(mesh, filename);
+        }
         return -1;
     }
 
-    template <int D>
-    static int write(const Mesh<D> &mesh, const std::string &filename) {
+    /*
+     * Reads filename through the binary snapshot cache_filename (see
+     * MeshCache.hpp): the snapshot is loaded if it was taken from the
+     * current content of filename with the same generator, otherwise the
+     * mesh file is parsed and the snapshot (re)written.
+     * @return 2 if loaded from the snapshot, otherwise the result of read()
+     */
+    template <int D, typename I>
+    static int read(Mesh<D, I> &mesh, const std::string &filename,
+                    const std::string &cache_filename,
+                    MshGenerator type = MshGenerator::GMSH) {
+        auto source_hash = mesh_cache::hash_file(filename);
+        {
+            MeshCache<D, I> cache(cache_filename);
+            if (source_hash != 0 and cache.good() and
+                cache.source_hash() == source_hash and
+                cache.element_ids() == static_cast<std::uint32_t>(type)) {
+                cache.load(mesh);
+                return 2;
+            }
+        }
+        auto status = read(mesh, filename, type);
+        if (status > 0) {
+            write_cache(mesh, cache_filename, source_hash, true, type);
+        }
+        return status;
+    }
+
+    /*
+     * Writes a snapshot of mesh keyed by source_hash, the
+     * mesh_cache::hash_file() of the file the mesh was read from, and by the
+     * generator type it was read with.
+     * @param with_connectivity also store what the mesh has built so far
+     */
+    template <int D, typename I>
+    static int write_cache(const Mesh<D, I> &mesh,
+                           const std::string &cache_filename,
+                           std::uint64_t source_hash,
+                           bool with_connectivity = true,
+                           MshGenerator type = MshGenerator::GMSH) {
+        if (not MeshCache<D, I>::write(mesh, cache_filename, source_hash,
+                                       with_connectivity,
+                                       static_cast<std::uint32_t>(type))) {
+            std::cerr << "Cannot write the mesh cache " << cache_filename
+                      << std::endl;
+            return -1;
+        }
+        return 1;
+    }
+
+    /*
+     * @param storage chunking and compression of the HDF5 datasets
+     */
+    template <int D, typename I>
+    static int write(const Mesh<D, I> &mesh, const std::string &filename,
+                     HDF5File::StorageOptions storage = {}) {
         // get the extension
         auto ext = filename.substr(filename.find_last_of('.') + 1);
-        if (ext == "h5" or ext == ".hdf5") {
-            _write_h5(mesh, filename);
+        if (ext == "h5" or ext == "hdf5") {
+            return _write_h5(mesh, filename, storage);
         }
         return -1;
     }
 
+    /*
+     * The share of a mesh held by one process of a distributed run, see
+     * read_slice(). Node indices are global and 0-based.
+     */
+    template <int D, typename I> struct Slice {
+        // global index of the first node of the slice
+        std::size_t first_node = 0;
+        // D coordinates per node
+        std::vector<double> nodes;
+        // prime elements grouped by FiniteElementType
+        CSRList<I> elements;
+        std::vector<I> element_ID;
+        // number of elements of every FiniteElementType
+        std::vector<std::size_t> type_count;
+    };
+
+    /*
+     * Reads slice part of num_parts of a Gmsh 2.2 ASCII mesh. $Nodes and
+     * $Elements are cut into num_parts line-aligned byte ranges, and only the
+     * nodes and the prime elements in the range of this part are parsed.
+     * The section headers are still found by scanning the mapped text. Node
+     * tags must be 1, 2, ..., #nodes in file order, as for read().
+     * @return 1 on success, -1 on error or another file format
+     */
+    template <int D, typename I>
+    static int read_slice(Slice<D, I> &slice, const std::string &filename,
+                          std::size_t part, std::size_t num_parts,
+                          MshGenerator type = MshGenerator::GMSH) {
+        MappedFile file(filename);
+        if (not file.good()) {
+            std::cerr << "Cannot open " << filename << std::endl;
+            return -1;
+        }
+        const char *end = file.end();
+        const char *p = _find_section(file.begin(), end, "$MeshFormat");
+        double version = 0;
+        int file_type = -1;
+        if (p) {
+            p = _parse(_parse(p, end, version), end, file_type);
+        }
+        if (p == nullptr or std::abs(version - 2.2) > 1e-6 or file_type != 0) {
+            std::cerr << "Slices can only be read from Gmsh 2.2 ASCII files: "
+                      << filename << std::endl;
+            return -1;
+        }
+
+        p = _find_section(p, end, "$Nodes");
+        if (p == nullptr) {
+            std::cerr << "Missing $Nodes section" << std::endl;
+            return -1;
+        }
+        std::size_t nnodes = 0;
+        p = _parse(p, end, nnodes);
+        if (p == nullptr) {
+            std::cerr << "Malformed $Nodes section" << std::endl;
+            return -1;
+        }
+        p = _next_line(p, end);
+        const char *nodes_end = _section_end(p, end, "$EndNodes");
+        auto [node_begin, node_end] =
+            _slice_lines(p, nodes_end, part, num_parts);
+        slice.first_node = 0;
+        slice.nodes.clear();
+        std::size_t count = 0;
+        for (const char *q = node_begin; q < node_end;
+             q = _next_line(q, node_end), ++count) {
+            std::size_t tag = 0;
+            q = _parse(q, node_end, tag);
+            if (q == nullptr) {
+                std::cerr << "Malformed $Nodes section" << std::endl;
+                return -1;
+            }
+            if (count == 0 and tag > 0) {
+                slice.first_node = tag - 1;
+            }
+            if (tag != slice.first_node + count + 1) {
+                std::cerr << "Node tags are not consecutive" << std::endl;
+                return -1;
+            }
+            for (int d = 0; d < D; ++d) {
+                double x = 0;
+                q = _parse(q, node_end, x);
+                slice.nodes.push_back(x);
+            }
+            if (q == nullptr) {
+                std::cerr << "Malformed $Nodes section" << std::endl;
+                return -1;
+            }
+        }
+
+        p = _find_section(nodes_end, end, "$Elements");
+        if (p == nullptr) {
+            std::cerr << "Missing $Elements section" << std::endl;
+            return -1;
+        }
+        std::size_t nelements = 0;
+        p = _parse(p, end, nelements);
+        if (p == nullptr) {
+            std::cerr << "Malformed $Elements section" << std::endl;
+            return -1;
+        }
+        p = _next_line(p, end);
+        auto [element_begin, element_end] = _slice_lines(
+            p, _section_end(p, end, "$EndElements"), part, num_parts);
+
+        // vertices per FiniteElementType, 0 for the types that are skipped
+        const auto num_types = ElementSpace<D>::all_element_types().size();
+        std::vector<int> num_vertices(num_types, 0);
+        for (auto t : ElementSpace<D>::prime_element_types()) {
+            num_vertices[static_cast<std::size_t>(t)] = _num_vertices<D>(t);
+        }
+
+        // count per type, then parse every element into the rows of its type
+        auto &type_count = slice.type_count;
+        type_count.assign(num_types, 0);
+        for (const char *q = element_begin; q < element_end;
+             q = _next_line(q, element_end)) {
+            std::size_t id, element_type = num_types;
+            q = _parse(_parse(q, element_end, id), element_end, element_type);
+            if (q == nullptr) {
+                std::cerr << "Malformed $Elements section" << std::endl;
+                return -1;
+            }
+            auto t = _gmsh_element_type<D>(element_type);
+            if (t < num_types and num_vertices[t]) {
+                ++type_count[t];
+            }
+        }
+        std::vector<std::size_t> cursor(num_types, 0);
+        std::vector<std::size_t> offset(1, 0);
+        for (std::size_t t = 0; t < num_types; ++t) {
+            cursor[t] = offset.size() - 1;
+            for (std::size_t k = 0; k < type_count[t]; ++k) {
+                offset.push_back(offset.back() + num_vertices[t]);
+            }
+        }
+        std::vector<I> data(offset.back());
+        slice.element_ID.assign(offset.size() - 1, 0);
+        for (const char *q = element_begin; q < element_end;
+             q = _next_line(q, element_end)) {
+            std::size_t id, element_type = num_types, num_tags = 0;
+            q = _parse(_parse(q, element_end, id), element_end, element_type);
+            element_type = _gmsh_element_type<D>(element_type);
+            if (element_type >= num_types or num_vertices[element_type] == 0) {
+                continue;
+            }
+            q = _parse(q, element_end, num_tags);
+            I ids[2] = {0, 0};
+            for (std::size_t j = 0; j < num_tags; ++j) {
+                // partition tags are negative for ghost elements
+                long long tag = 0;
+                q = _parse(q, element_end, tag);
+                if (j < 2) {
+                    ids[j] = static_cast<I>(tag);
+                }
+            }
+            auto row = cursor[element_type]++;
+            slice.element_ID[row] = ids[static_cast<int>(type)];
+            auto node_list = data.begin() + offset[row];
+            for (int j = 0; j < num_vertices[element_type]; j++) {
+                q = _parse(q, element_end, node_list[j]);
+                node_list[j]--;
+            }
+            if (q == nullptr) {
+                std::cerr << "Malformed $Elements section" << std::endl;
+                return -1;
+            }
+            if (static_cast<FiniteElementType>(element_type) ==
+                FiniteElementType::Pyramid) {
+                std::swap(node_list[2], node_list[3]);
+            }
+        }
+        slice.elements = CSRList<I>(std::move(data), std::move(offset));
+        return 1;
+    }
+
 private:
+    static const char *_skip_space(const char *p, const char *end) {
+        while (p < end and (*p == ' ' or *p == '\t' or *p == '\r' or
+                            *p == '\n')) {
+            ++p;
+        }
+        return p;
+    }
+
+    static const char *_next_line(const char *p, const char *end) {
+        p = static_cast<const char *>(std::memchr(p, '\n', end - p));
+        return p ? p + 1 : end;
+    }
+
+    /*
+     * Parses one number after optional white space.
+     * @return the position past the number, or nullptr if there is no
+     * number or it does not fit T; nullptr is passed through, so calls can
+     * be chained and checked once
+     */
     template <typename T>
-    static const char *str_parsing(const char *str, T &value) {
-        char *endptr = nullptr;
-        if constexpr (std::is_integral_v<T>) {
-            value = static_cast<T>(std::strtol(str, &endptr, 10));
+    static const char *_parse(const char *p, const char *end, T &value) {
+        if (p == nullptr) {
+            return nullptr;
         }
+        p = _skip_space(p, end);
         if constexpr (std::is_floating_point_v<T>) {
-            value = static_cast<T>(std::strtod(str, &endptr));
+#if defined(__cpp_lib_to_chars)
+            auto [ptr, ec] = std::from_chars(p, end, value);
+            return ec == std::errc() ? ptr : nullptr;
+#else
+            // no floating-point from_chars; the mapped text always ends
+            // with "$End..." so strtod stops inside the mapping
+            char *endptr = nullptr;
+            value = static_cast<T>(std::strtod(p, &endptr));
+            return endptr == p ? nullptr : endptr;
+#endif
+        } else {
+            auto [ptr, ec] = std::from_chars(p, end, value);
+            return ec == std::errc() ? ptr : nullptr;
         }
-        return endptr;
+    }
 
-        if constexpr (std::is_same_v<T, void>) {
-            char *tmp0, *tmp1;
-            std::strtol(str, &tmp0, 10);
-            std::strtod(str, &tmp1);
-            if (tmp0 != tmp1) {
-                // floating point conversion
-                tmp0 = tmp1;
+    /*
+     * @return the first position after the line that starts with `tag`, or
+     * nullptr if there is no such line
+     */
+    static const char *_find_section(const char *begin, const char *end,
+                                     const std::string &tag) {
+        for (auto p = begin; p < end; p = _next_line(p, end)) {
+            if (static_cast<std::size_t>(end - p) >= tag.size() and
+                std::memcmp(p, tag.data(), tag.size()) == 0 and
+                (p + tag.size() == end or
+                 std::isspace(static_cast<unsigned char>(p[tag.size()])))) {
+                return _next_line(p, end);
             }
-            return tmp0;
         }
+        return nullptr;
     }
-    template <int D>
-    static int _read_gmsh(Mesh<D> &mesh, const std::string &filename,
+
+    template <int D, typename I>
+    static int _read_gmsh(Mesh<D, I> &mesh, const std::string &filename,
                           MshGenerator type) {
 
         static_assert(D == std::decay_t<decltype(mesh)>::dim());
-        mesh.nodes().clear();
 
-        std::ifstream fmesh(filename);
-        assert(fmesh.good());
-
-        std::string line;
+        MappedFile file(filename);
+        if (not file.good()) {
+            std::cerr << "Cannot open " << filename << std::endl;
+            return -1;
+        }
+        const char *begin = file.begin();
+        const char *end = file.end();
 
-        std::getline(fmesh, line); // "#MeshFormat"
-        std::getline(fmesh, line); // Version info
+        // "$MeshFormat": version, file type (0: ASCII), data size
+        const char *p = _find_section(begin, end, "$MeshFormat");
+        if (p == nullptr) {
+            std::cerr << "Not a gmsh file: " << filename << std::endl;
+            return -1;
+        }
+        double version = 0;
+        int file_type = 0;
+        _MshFormat format;
+        p = _parse(p, end, version);
+        p = _parse(p, end, file_type);
+        p = _parse(p, end, format.size_bytes);
+        if (p == nullptr) {
+            std::cerr << "Malformed $MeshFormat section" << std::endl;
+            return -1;
+        }
+        p = _next_line(p, end);
+        if (file_type == 1) {
+            // the integer 1 written in binary tells the byte order
+            if (end - p < 4) {
+                return -1;
+            }
+            format.binary = true;
+            format.swap = _load<std::int32_t>(p, false) != 1;
+            if (format.swap and _load<std::int32_t>(p, true) != 1) {
+                std::cerr << "Corrupted binary gmsh header" << std::endl;
+                return -1;
+            }
+            if (format.size_bytes != 4 and format.size_bytes != 8) {
+                std::cerr << "Unsupported data size: " << format.size_bytes
+                          << std::endl;
+                return -1;
+            }
+        }
+        p = _next_line(_section_end(p, end, "$EndMeshFormat"), end);
 
-        double version;
-        int tmp[2];
-        std::sscanf(line.c_str(), "%lf %d %d", &version, tmp, tmp + 1);
         // find version gmsh2.2
         if (std::abs(version - 2.2) < 1e-6) {
-            return _read_gmsh22(mesh, fmesh, type);
+            if (format.binary) {
+                return _read_gmsh22_binary(mesh, p, end, type, format);
+            }
+            return _read_gmsh22(mesh, p, end, type);
         }
         // find version gmsh4.0
         else if (std::abs(version - 4.0) < 1e-6) {
-            return _read_gmsh40(mesh, fmesh, type);
+            return _read_gmsh40(mesh, p, end, type);
         }
         // find version gmsh4.1
         else if (std::abs(version - 4.1) < 1e-6) {
-            return _read_gmsh41(mesh, fmesh, type);
+            return _read_gmsh41(mesh, p, end, type, format);
+        }
+        std::cerr << "Unknown gmsh format: " << version << std::endl;
+        return -1;
+    }
+
+    struct _MshFormat {
+        bool binary = false;
+        // byte order of the file differs from the host
+        bool swap = false;
+        // size of size_t in the file
+        std::size_t size_bytes = 8;
+    };
+
+    template <typename T> static T _load(const char *p, bool swap) {
+        T value;
+        if (swap) {
+            char bytes[sizeof(T)];
+            std::reverse_copy(p, p + sizeof(T), bytes);
+            std::memcpy(&value, bytes, sizeof(T));
         } else {
-            std::cerr << "Unknown gmsh format: " << version << std::endl;
-            return -1;
+            std::memcpy(&value, p, sizeof(T));
+        }
+        return value;
+    }
+
+    /*
+     * Sequential reader of the int, size_t and double tokens of a Gmsh file,
+     * from text or from native/swapped binary. A token that cannot be parsed
+     * reads as 0 and sets `malformed`.
+     */
+    struct _MshStream {
+        const char *p;
+        const char *end;
+        _MshFormat format;
+        bool malformed = false;
+
+        template <typename T> void text(T &value) {
+            if (auto q = _parse(p, end, value)) {
+                p = q;
+            } else {
+                malformed = true;
+            }
+        }
+
+        std::size_t size() {
+            std::size_t value = 0;
+            if (not format.binary) {
+                text(value);
+            } else if (format.size_bytes == 8) {
+                value = _load<std::uint64_t>(p, format.swap);
+                p += 8;
+            } else {
+                value = _load<std::uint32_t>(p, format.swap);
+                p += 4;
+            }
+            return value;
+        }
+
+        int integer() {
+            int value = 0;
+            if (format.binary) {
+                value = _load<std::int32_t>(p, format.swap);
+                p += 4;
+            } else {
+                text(value);
+            }
+            return value;
+        }
+
+        double real() {
+            double value = 0;
+            if (format.binary) {
+                value = _load<double>(p, format.swap);
+                p += 8;
+            } else {
+                text(value);
+            }
+            return value;
+        }
+
+        // skips num_lines lines of text, or num_bytes bytes of binary data
+        void skip(std::size_t num_lines, std::size_t num_bytes) {
+            if (format.binary) {
+                p = std::min(p + num_bytes, end);
+            } else {
+                p = _next_line(p, end);
+                for (std::size_t i = 0; i < num_lines; ++i) {
+                    p = _next_line(p, end);
+                }
+            }
+        }
+    };
+
+    // number of nodes of a Gmsh element type, 0 if unknown
+    static std::size_t _gmsh_num_nodes(int gmsh_type) {
+        static const std::size_t table[] = {
+            0,  2,  3,  4,  4,  8,  6,  5,  3,  6,  9,  10, 27, 18, 14, 1,
+            8,  20, 15, 13, 9,  10, 12, 15, 15, 21, 4,  5,  6,  20, 35, 56};
+        if (gmsh_type >= 0 and
+            gmsh_type < static_cast<int>(sizeof(table) / sizeof(table[0]))) {
+            return table[gmsh_type];
         }
-        fmesh.close();
         return 0;
     }
+
+    /*
+     * FiniteElementType read for a Gmsh element type, or the number of
+     * FiniteElementTypes if elements of the type are skipped. The two are
+     * numbered alike, but the node counts must match as well, so e.g. the
+     * 3-node line (Gmsh type 8) is not read as an IGA2 element.
+     */
     template <int D>
-    static int _read_gmsh22(Mesh<D> &mesh, std::ifstream &fmesh,
-                            MshGenerator type = MshGenerator::GMSH) {
-        std::string line;
-        std::getline(fmesh, line); // "$EndMeshFormat"
-        std::getline(fmesh, line); // "$Nodes"
-                                   // read nodes
-        std::getline(fmesh, line); // Number of nodes
-        std::size_t nnodes;
-        // sscanf(line.c_str(), "%zu\n", &nnodes);
-        str_parsing(line.c_str(), nnodes);
-
-        std::vector<double> &node_coordinates = mesh.nodes();
-        node_coordinates.reserve(nnodes * mesh.dim());
-
-        int tmp;
-        double x[D];
-        for (std::size_t i = 0; i < nnodes; ++i) {
-            std::getline(fmesh, line);
-            const char *p = line.c_str();
-
-            p = str_parsing(p, tmp);
-            if constexpr (D >= 1)
-                p = str_parsing(p, x[0]);
-            if constexpr (D >= 2)
-                p = str_parsing(p, x[1]);
-            if constexpr (D >= 3)
-                p = str_parsing(p, x[2]);
-            node_coordinates.insert(node_coordinates.end(), x, x + D);
-            // node_csrlist.push_back(std::vector<typename
-            // std::decay_t<decltype(node_csrlist)>::data_type>(x, x + D));
-        }
-
-        // read elements
-        // initialize element map
-        std::map<FiniteElementType, typename Mesh<D>::MeshElementInfo>
-            _element_all;
-        {
-            for (auto type : ElementSpace<D>().all_element_types()) {
-                auto index = static_cast<int>(type);
-                _element_all[type];
+    static std::size_t _gmsh_element_type(std::size_t gmsh_type) {
+        const auto num_types = ElementSpace<D>::all_element_types().size();
+        if (gmsh_type < num_types and
+            static_cast<int>(_gmsh_num_nodes(static_cast<int>(gmsh_type))) ==
+                _num_vertices<D>(static_cast<FiniteElementType>(gmsh_type))) {
+            return gmsh_type;
+        }
+        return num_types;
+    }
+
+    // smallest chunk of text worth handing to a thread
+    static constexpr std::size_t _min_chunk_bytes = 1 << 16;
+
+    /*
+     * @return the start of the line beginning with `tag` at or after p, i.e.
+     * the end of the section that p points into, or `end`
+     */
+    static const char *_section_end(const char *p, const char *end,
+                                    const std::string &tag) {
+        std::string_view text(p, end - p);
+        if (text.compare(0, tag.size(), tag) == 0) {
+            return p;
+        }
+        auto pos = text.find("\n" + tag);
+        return pos == std::string_view::npos ? end : p + pos + 1;
+    }
+
+    /*
+     * Splits [begin, end) into chunks starting at the beginning of a line,
+     * as many as there are threads but none smaller than _min_chunk_bytes.
+     * @return the num_chunks + 1 chunk boundaries
+     */
+    static std::vector<const char *>
+    _split_lines(const char *begin, const char *end, std::size_t num_threads) {
+        std::size_t size = end - begin;
+        std::size_t num_chunks = std::max<std::size_t>(
+            1, std::min(num_threads, size / _min_chunk_bytes));
+        std::vector<const char *> bounds{begin};
+        for (std::size_t i = 1; i < num_chunks; ++i) {
+            const char *p = begin + size * i / num_chunks;
+            p = _next_line(p - 1, end);
+            bounds.push_back(std::max(p, bounds.back()));
+        }
+        bounds.push_back(end);
+        return bounds;
+    }
+
+    /*
+     * @return piece part of [begin, end) cut into num_parts line-aligned
+     * pieces of about the same size; every caller computes the same cuts
+     */
+    static std::pair<const char *, const char *>
+    _slice_lines(const char *begin, const char *end, std::size_t part,
+                 std::size_t num_parts) {
+        auto bound = [&](std::size_t k) {
+            if (k >= num_parts) {
+                return end;
             }
+            const char *p = begin + (end - begin) * k / num_parts;
+            return p == begin ? begin : _next_line(p - 1, end);
+        };
+        return {bound(part), bound(part + 1)};
+    }
+
+    /*
+     * Reads a Gmsh 2.2 ASCII mesh from the mapped text [begin, end).
+     * $Nodes and $Elements are split into line-aligned chunks parsed by
+     * mesh.num_threads() threads. Nodes: the lines of each chunk are counted
+     * and scanned into the index of its first node. Elements: each chunk
+     * counts its elements per type, a scan over (type, chunk) yields the
+     * first row of every chunk within each type group, and the chunks then
+     * parse their elements straight into those rows of mesh.elements(),
+     * grouped by FiniteElementType as in type_offset(). The result does not
+     * depend on the number of threads. The Vertex group holds one element
+     * per node. Element types that the mesh dimension does not know are
+     * skipped. Node tags are assumed to be 1, 2, ..., #nodes in file order.
+     */
+    template <int D, typename I>
+    static int _read_gmsh22(Mesh<D, I> &mesh, const char *begin,
+                            const char *end,
+                            MshGenerator type = MshGenerator::GMSH) {
+        const auto num_threads = mesh.num_threads();
+        const char *p = _find_section(begin, end, "$Nodes");
+        if (p == nullptr) {
+            std::cerr << "Missing $Nodes section" << std::endl;
+            return -1;
+        }
+        std::size_t nnodes = 0;
+        p = _parse(p, end, nnodes);
+        if (p == nullptr) {
+            std::cerr << "Malformed $Nodes section" << std::endl;
+            return -1;
         }
+        p = _next_line(p, end);
 
-        std::getline(fmesh, line); // "$EndNodes"
-        std::getline(fmesh, line); // "$Elements"
-        std::getline(fmesh, line); // number of Elements
-        // fill vertex element
+        auto &node_coordinates = mesh.nodes();
+        node_coordinates.resize(nnodes * D);
         {
-            auto &[csrlist, element_id] =
-                _element_all.at(FiniteElementType::Vertex);
-            csrlist.data().resize(nnodes);
-            csrlist.offset().resize(nnodes + 1);
-
-            std::iota(csrlist.data().begin(), csrlist.data().end(), 0);
-            std::iota(csrlist.offset().begin(), csrlist.offset().end(), 0);
-
-            element_id.resize(nnodes);
-        }
-        std::size_t nelements;
-        str_parsing(line.c_str(), nelements);
-
-        for (std::size_t i = 0; i < nelements; ++i) {
-            /*
-             * Line content:
-             * ElementID(1-based), ElementType, Number of tags, <tags...>, <node
-             * list...>
-             */
-            std::getline(fmesh, line);
-            const char *p = line.c_str();
-            // ElementID
-            p = str_parsing(p, tmp);
-            // ElementType
-            p = str_parsing(p, tmp);
-            auto element_type =
-                static_cast<typename ElementSpace<D>::Type>(tmp);
-            int num_vertices = _num_vertices<D>(element_type);
-            auto &info = _element_all[element_type];
-            // Number of tags (==2)
-            int num_tags = 2;
-            p = str_parsing(p, num_tags);
-            int ids[2];
-            for (std::size_t j = 0; j < num_tags; ++j) {
-                p = str_parsing(p, ids[j]);
+            const char *nodes_end = _section_end(p, end, "$EndNodes");
+            auto bounds = _split_lines(p, nodes_end, num_threads);
+            const std::size_t num_chunks = bounds.size() - 1;
+            std::vector<std::size_t> first_node(num_chunks + 1, 0);
+            parallel::for_each_chunk(
+                num_chunks, num_threads,
+                [&](std::size_t chunk_begin, std::size_t chunk_end,
+                    std::size_t) {
+                    for (auto c = chunk_begin; c < chunk_end; ++c) {
+                        first_node[c + 1] =
+                            std::count(bounds[c], bounds[c + 1], '\n');
+                    }
+                });
+            std::partial_sum(first_node.begin(), first_node.end(),
+                             first_node.begin());
+            if (first_node.back() < nnodes) {
+                std::cerr << "Truncated $Nodes section" << std::endl;
+                return -1;
+            }
+            std::atomic<bool> malformed{false};
+            parallel::for_each_chunk(
+                num_chunks, num_threads,
+                [&](std::size_t chunk_begin, std::size_t chunk_end,
+                    std::size_t) {
+                    for (auto c = chunk_begin; c < chunk_end; ++c) {
+                        const char *q = bounds[c];
+                        auto last = std::min(first_node[c + 1], nnodes);
+                        for (auto i = first_node[c]; i < last; ++i) {
+                            std::size_t tag = 0;
+                            q = _parse(q, bounds[c + 1], tag);
+                            for (int d = 0; d < D; ++d) {
+                                q = _parse(q, bounds[c + 1],
+                                           node_coordinates[i * D + d]);
+                            }
+                            if (q == nullptr) {
+                                malformed = true;
+                                return;
+                            }
+                            q = _next_line(q, bounds[c + 1]);
+                        }
+                    }
+                });
+            if (malformed) {
+                std::cerr << "Malformed $Nodes section" << std::endl;
+                return -1;
             }
-            auto &element_node_list = std::get<0>(info);
-            auto &element_ID = std::get<1>(info);
+            p = nodes_end;
+        }
 
-            element_ID.push_back(ids[static_cast<int>(type)]);
+        p = _find_section(p, end, "$Elements");
+        if (p == nullptr) {
+            std::cerr << "Missing $Elements section" << std::endl;
+            return -1;
+        }
+        std::size_t nelements = 0;
+        p = _parse(p, end, nelements);
+        if (p == nullptr) {
+            std::cerr << "Malformed $Elements section" << std::endl;
+            return -1;
+        }
+        p = _next_line(p, end);
+        const char *elements_end = _section_end(p, end, "$EndElements");
+        auto bounds = _split_lines(p, elements_end, num_threads);
+        const std::size_t num_chunks = bounds.size() - 1;
 
-            std::vector<
-                typename std::decay_t<decltype(element_node_list)>::data_type>
-                node_list(num_vertices);
-            for (int j = 0; j < num_vertices; j++) {
-                p = str_parsing(p, node_list[j]);
-                node_list[j]--;
+        // vertices per FiniteElementType
+        const auto num_types = ElementSpace<D>::all_element_types().size();
+        std::vector<int> num_vertices(num_types);
+        for (std::size_t t = 0; t < num_types; ++t) {
+            num_vertices[t] =
+                _num_vertices<D>(static_cast<FiniteElementType>(t));
+        }
+
+        // elements of each type in each chunk; becomes the first row of the
+        // chunk within the whole CSR after the scan below
+        std::vector<std::vector<std::size_t>> cursor(
+            num_chunks, std::vector<std::size_t>(num_types, 0));
+        std::atomic<bool> malformed{false};
+        parallel::for_each_chunk(
+            num_chunks, num_threads,
+            [&](std::size_t chunk_begin, std::size_t chunk_end, std::size_t) {
+                for (auto c = chunk_begin; c < chunk_end; ++c) {
+                    for (const char *q = bounds[c]; q < bounds[c + 1];
+                         q = _next_line(q, bounds[c + 1])) {
+                        std::size_t id, element_type = num_types;
+                        q = _parse(_parse(q, bounds[c + 1], id), bounds[c + 1],
+                                   element_type);
+                        if (q == nullptr) {
+                            malformed = true;
+                            return;
+                        }
+                        auto t = _gmsh_element_type<D>(element_type);
+                        if (t < num_types) {
+                            ++cursor[c][t];
+                        }
+                    }
+                }
+            });
+        if (malformed) {
+            std::cerr << "Malformed $Elements section" << std::endl;
+            return -1;
+        }
+
+        // rows and data of each type in the final CSR
+        auto &type_offset = mesh.type_offset();
+        type_offset.assign(1, 0);
+        std::vector<std::size_t> data_begin(num_types + 1, 0);
+        std::size_t num_elements = 0;
+        for (std::size_t t = 0; t < num_types; ++t) {
+            num_elements =
+                t == static_cast<int>(FiniteElementType::Vertex) ? nnodes : 0;
+            for (std::size_t c = 0; c < num_chunks; ++c) {
+                num_elements += cursor[c][t];
+            }
+            type_offset.push_back(type_offset.back() + num_elements);
+            data_begin[t + 1] = data_begin[t] + num_elements * num_vertices[t];
+        }
+        for (std::size_t t = 0; t < num_types; ++t) {
+            std::size_t row = type_offset[t];
+            if (t == static_cast<int>(FiniteElementType::Vertex)) {
+                row += nnodes;
+            }
+            for (std::size_t c = 0; c < num_chunks; ++c) {
+                auto count = cursor[c][t];
+                cursor[c][t] = row;
+                row += count;
             }
+        }
 
-            // for Pyramid element, renumbering by swap node_list[2] and
-            // node_list[3]
-            if (element_type == FiniteElementType::Pyramid) {
-                std::swap(node_list[2], node_list[3]);
+        auto &[element_info, element_ID] = mesh.elements();
+        auto &offset = element_info.offset();
+        auto &data = element_info.data();
+        offset.resize(type_offset.back() + 1);
+        data.resize(data_begin.back());
+        element_ID.assign(type_offset.back(), 0);
+        offset[0] = 0;
+        for (std::size_t t = 0; t < num_types; ++t) {
+            for (auto row = type_offset[t]; row < type_offset[t + 1]; ++row) {
+                offset[row + 1] =
+                    data_begin[t] +
+                    (row - type_offset[t] + 1) * num_vertices[t];
             }
-            element_node_list.push_back(node_list);
         }
+        // one Vertex element per node
+        std::iota(data.begin(), data.begin() + nnodes, static_cast<I>(0));
 
-        // immigrate data from _element_all to mesh.elements()
-        {
-            auto &type_offset = mesh.type_offset();
-            auto &[element_info, element_ID] = mesh.elements();
-            for (const auto &[key, value] : _element_all) {
-                element_info += std::get<0>(value);
-                element_ID.insert(element_ID.end(), std::get<1>(value).begin(),
-                                  std::get<1>(value).end());
-                type_offset.push_back(element_info.size());
-                // std::cout << "type_offset: " << type_offset.size() <<
-                // std::endl; printf("type_offset: %zu %zu\n, ",
-                // type_offset.size(), type_offset.back()); printf("size =
-                // %zu\n", [key].first.size());
+        /*
+         * Line content:
+         * ElementID(1-based), ElementType, Number of tags, <tags...>, <node
+         * list...>
+         */
+        parallel::for_each_chunk(
+            num_chunks, num_threads,
+            [&](std::size_t chunk_begin, std::size_t chunk_end, std::size_t) {
+                for (auto c = chunk_begin; c < chunk_end; ++c) {
+                    const char *chunk_end_ptr = bounds[c + 1];
+                    for (const char *q = bounds[c]; q < chunk_end_ptr;
+                         q = _next_line(q, chunk_end_ptr)) {
+                        std::size_t id, element_type = num_types, num_tags = 0;
+                        q = _parse(_parse(q, chunk_end_ptr, id), chunk_end_ptr,
+                                   element_type);
+                        element_type = _gmsh_element_type<D>(element_type);
+                        if (element_type >= num_types) {
+                            continue;
+                        }
+                        q = _parse(q, chunk_end_ptr, num_tags);
+                        I ids[2] = {0, 0};
+                        for (std::size_t j = 0; j < num_tags; ++j) {
+                            // partition tags are negative for ghost
+                            // elements
+                            long long tag = 0;
+                            q = _parse(q, chunk_end_ptr, tag);
+                            if (j < 2) {
+                                ids[j] = static_cast<I>(tag);
+                            }
+                        }
+                        auto row = cursor[c][element_type]++;
+                        element_ID[row] = ids[static_cast<int>(type)];
+                        auto node_list = data.begin() + offset[row];
+                        for (int j = 0; j < num_vertices[element_type]; j++) {
+                            q = _parse(q, chunk_end_ptr, node_list[j]);
+                            node_list[j]--;
+                        }
+                        if (q == nullptr) {
+                            malformed = true;
+                            return;
+                        }
+
+                        // for Pyramid element, renumbering by swap
+                        // node_list[2] and node_list[3]
+                        if (static_cast<FiniteElementType>(element_type) ==
+                            FiniteElementType::Pyramid) {
+                            std::swap(node_list[2], node_list[3]);
+                        }
+                    }
+                }
+            });
+        if (malformed) {
+            std::cerr << "Malformed $Elements section" << std::endl;
+            return -1;
+        }
+        if (type_offset.back() - nnodes > nelements) {
+            std::cerr << "Inconsistent $Elements section" << std::endl;
+            return -1;
+        }
+
+        return 1;
+    }
+
+    /*
+     * Reads a binary Gmsh 2.2 mesh from [begin, end). A node is an int tag
+     * followed by three doubles, copied with one memcpy per node on a
+     * native-endian 3D mesh. $Elements is a sequence of groups of one type
+     * (header: type, count, number of tags) whose elements are ints: tag,
+     * tags, nodes. The group headers are walked first to size the CSR, then
+     * every group, cut into pieces of at most _max_piece elements, is
+     * copied in bulk into a buffer and scattered into its rows concurrently.
+     * The result is the same as for the ASCII file.
+     */
+    template <int D, typename I>
+    static int _read_gmsh22_binary(Mesh<D, I> &mesh, const char *begin,
+                                   const char *end, MshGenerator type,
+                                   _MshFormat format) {
+        const auto num_threads = mesh.num_threads();
+        const bool swap = format.swap;
+        const char *p = _find_section(begin, end, "$Nodes");
+        if (p == nullptr) {
+            std::cerr << "Missing $Nodes section" << std::endl;
+            return -1;
+        }
+        std::size_t nnodes = 0;
+        p = _parse(p, end, nnodes);
+        if (p == nullptr) {
+            std::cerr << "Malformed $Nodes section" << std::endl;
+            return -1;
+        }
+        p = _next_line(p, end);
+        constexpr std::size_t node_bytes = sizeof(std::int32_t) + 3 * 8;
+        if (static_cast<std::size_t>(end - p) < nnodes * node_bytes) {
+            std::cerr << "Truncated $Nodes section" << std::endl;
+            return -1;
+        }
+        auto &node_coordinates = mesh.nodes();
+        node_coordinates.resize(nnodes * D);
+        parallel::for_each_chunk(
+            nnodes, num_threads,
+            [&](std::size_t node_begin, std::size_t node_end, std::size_t) {
+                for (auto i = node_begin; i < node_end; ++i) {
+                    const char *x = p + i * node_bytes + sizeof(std::int32_t);
+                    if (D == 3 and not swap) {
+                        std::memcpy(&node_coordinates[i * D], x,
+                                    3 * sizeof(double));
+                        continue;
+                    }
+                    for (int d = 0; d < D; ++d) {
+                        node_coordinates[i * D + d] =
+                            _load<double>(x + d * sizeof(double), swap);
+                    }
+                }
+            });
+        p += nnodes * node_bytes;
+
+        p = _find_section(p, end, "$Elements");
+        if (p == nullptr) {
+            std::cerr << "Missing $Elements section" << std::endl;
+            return -1;
+        }
+        std::size_t nelements = 0;
+        p = _parse(p, end, nelements);
+        if (p == nullptr) {
+            std::cerr << "Malformed $Elements section" << std::endl;
+            return -1;
+        }
+        p = _next_line(p, end);
+
+        const auto num_types = ElementSpace<D>::all_element_types().size();
+        const auto vertex_type =
+            static_cast<std::size_t>(FiniteElementType::Vertex);
+        struct ElementPiece {
+            const char *p;
+            std::size_t type, first, count, num_tags;
+        };
+        std::vector<ElementPiece> element_pieces;
+        std::vector<std::size_t> num_elements(num_types, 0);
+        for (std::size_t i = 0; i < nelements;) {
+            if (end - p < 3 * 4) {
+                std::cerr << "Truncated $Elements section" << std::endl;
+                return -1;
+            }
+            auto gmsh_type = _load<std::int32_t>(p, swap);
+            std::size_t count = _load<std::int32_t>(p + 4, swap);
+            std::size_t num_tags = _load<std::int32_t>(p + 8, swap);
+            p += 3 * 4;
+            auto num_nodes = _gmsh_num_nodes(gmsh_type);
+            if (num_nodes == 0) {
+                std::cerr << "Unknown gmsh element type: " << gmsh_type
+                          << std::endl;
+                return -1;
+            }
+            auto t = _gmsh_element_type<D>(gmsh_type);
+            auto stride = (1 + num_tags + num_nodes) * 4;
+            if (i + count > nelements) {
+                std::cerr << "Inconsistent $Elements section" << std::endl;
+                return -1;
+            }
+            for (std::size_t k = 0; k < count; k += _max_piece) {
+                auto n = std::min(_max_piece, count - k);
+                if (t < num_types) {
+                    element_pieces.push_back(
+                        {p + k * stride, t, num_elements[t], n, num_tags});
+                    num_elements[t] += n;
+                }
+            }
+            if (static_cast<std::size_t>(end - p) < count * stride) {
+                std::cerr << "Truncated $Elements section" << std::endl;
+                return -1;
+            }
+            p += count * stride;
+            i += count;
+        }
+
+        num_elements[vertex_type] += nnodes;
+        auto &type_offset = mesh.type_offset();
+        type_offset.assign(1, 0);
+        std::vector<std::size_t> data_begin(num_types + 1, 0);
+        std::vector<int> num_vertices(num_types);
+        for (std::size_t t = 0; t < num_types; ++t) {
+            num_vertices[t] =
+                _num_vertices<D>(static_cast<FiniteElementType>(t));
+            type_offset.push_back(type_offset.back() + num_elements[t]);
+            data_begin[t + 1] =
+                data_begin[t] + num_elements[t] * num_vertices[t];
+        }
+        auto &[element_info, element_ID] = mesh.elements();
+        auto &offset = element_info.offset();
+        auto &data = element_info.data();
+        offset.resize(type_offset.back() + 1);
+        data.resize(data_begin.back());
+        element_ID.assign(type_offset.back(), 0);
+        offset[0] = 0;
+        for (std::size_t t = 0; t < num_types; ++t) {
+            for (auto row = type_offset[t]; row < type_offset[t + 1]; ++row) {
+                offset[row + 1] =
+                    data_begin[t] +
+                    (row - type_offset[t] + 1) * num_vertices[t];
             }
         }
+        // one Vertex element per node
+        std::iota(data.begin(), data.begin() + nnodes, static_cast<I>(0));
+
+        parallel::for_each_chunk(
+            element_pieces.size(), num_threads,
+            [&](std::size_t piece_begin, std::size_t piece_end, std::size_t) {
+                std::vector<std::int32_t> buffer;
+                for (auto k = piece_begin; k < piece_end; ++k) {
+                    const auto &piece = element_pieces[k];
+                    const auto nv = num_vertices[piece.type];
+                    const auto stride = 1 + piece.num_tags + nv;
+                    buffer.resize(piece.count * stride);
+                    std::memcpy(buffer.data(), piece.p,
+                                buffer.size() * sizeof(std::int32_t));
+                    if (swap) {
+                        for (auto &v : buffer) {
+                            v = _load<std::int32_t>(
+                                reinterpret_cast<const char *>(&v), true);
+                        }
+                    }
+                    auto first = type_offset[piece.type] + piece.first +
+                                 (piece.type == vertex_type ? nnodes : 0);
+                    for (std::size_t i = 0; i < piece.count; ++i) {
+                        const auto *element = buffer.data() + i * stride;
+                        auto row = first + i;
+                        // tags: physical, elementary
+                        auto tag = static_cast<std::size_t>(type);
+                        element_ID[row] =
+                            tag < piece.num_tags ? element[1 + tag] : 0;
+                        auto node_list = data.begin() + offset[row];
+                        const auto *nodes = element + 1 + piece.num_tags;
+                        for (int j = 0; j < nv; ++j) {
+                            node_list[j] = nodes[j] - 1;
+                        }
+                        if (static_cast<FiniteElementType>(piece.type) ==
+                            FiniteElementType::Pyramid) {
+                            std::swap(node_list[2], node_list[3]);
+                        }
+                    }
+                }
+            });
 
         return 1;
     }
 
-    template <int D>
-    static int _read_gmsh40(Mesh<D> &mesh, std::ifstream &fmesh,
+    template <int D, typename I>
+    static int _read_gmsh40(Mesh<D, I> &mesh, const char *begin,
+                            const char *end,
                             MshGenerator type = MshGenerator::GMSH) {
         std::cerr << "Not implemented: " << __func__ << std::endl;
         return -2;
     }
 
-    template <int D>
-    static int _read_gmsh41(Mesh<D> &mesh, std::ifstream &fmesh,
-                            MshGenerator type = MshGenerator::GMSH) {
-        std::cerr << "Not implemented: " << __func__ << std::endl;
-        return -2;
+    // largest number of nodes or elements parsed as one task
+    static constexpr std::size_t _max_piece = 1 << 14;
+
+    /*
+     * Reads a Gmsh 4.1 mesh, ASCII or binary, from [begin, end).
+     * $Entities gives the physical tag of every entity. The entity blocks
+     * of $Nodes and $Elements are first walked through their headers only
+     * (binary payloads are skipped by size, text lines by memchr) and cut
+     * into pieces of at most _max_piece entries; once the sizes per type
+     * are known, the pieces are parsed concurrently straight into
+     * mesh.nodes() and mesh.elements(). Binary coordinates of a 3D mesh are
+     * copied in bulk. Node tags may be sparse and in any order; nodes keep
+     * the file order. Element IDs are the first physical tag of the entity
+     * (GMSH) or the entity tag itself (ANSA). Element types other than the
+     * linear line, triangle, quadrangle, tetrahedron, hexahedron, prism and
+     * pyramid are skipped.
+     */
+    template <int D, typename I>
+    static int _read_gmsh41(Mesh<D, I> &mesh, const char *begin,
+                            const char *end,
+                            MshGenerator type = MshGenerator::GMSH,
+                            _MshFormat format = _MshFormat()) {
+        const auto num_threads = mesh.num_threads();
+        const auto num_types = ElementSpace<D>::all_element_types().size();
+        const auto vertex_type =
+            static_cast<std::size_t>(FiniteElementType::Vertex);
+        // FiniteElementType of a Gmsh element type, num_types if skipped
+        // first physical tag of each entity, per dimension
+        std::array<std::unordered_map<int, int>, 4> physical_tag;
+
+        struct NodePiece {
+            const char *tags;
+            const char *coordinates;
+            std::size_t first, count, num_parametric;
+        };
+        std::vector<NodePiece> node_pieces;
+        std::size_t nnodes = 0;
+        std::size_t max_node_tag = 0;
+
+        struct ElementPiece {
+            const char *p;
+            std::size_t type, first, count, stride;
+            I id;
+        };
+        std::vector<ElementPiece> element_pieces;
+        std::vector<std::size_t> num_elements(num_types, 0);
+
+        bool has_nodes = false, has_elements = false;
+        _MshStream in{begin, end, format};
+        while (in.p < end) {
+            if (*in.p != '$') {
+                in.p = _next_line(in.p, end);
+                continue;
+            }
+            const char *name_end = in.p;
+            while (name_end < end and
+                   not std::isspace(static_cast<unsigned char>(*name_end))) {
+                ++name_end;
+            }
+            std::string name(in.p + 1, name_end);
+            in.p = _next_line(in.p, end);
+
+            if (name == "Entities") {
+                std::size_t num_entities[4];
+                for (auto &n : num_entities) {
+                    n = in.size();
+                }
+                for (int dim = 0; dim < 4; ++dim) {
+                    for (std::size_t i = 0; i < num_entities[dim]; ++i) {
+                        int tag = in.integer();
+                        for (int k = 0; k < (dim == 0 ? 3 : 6); ++k) {
+                            in.real();
+                        }
+                        auto num_physicals = in.size();
+                        for (std::size_t k = 0; k < num_physicals; ++k) {
+                            int physical = in.integer();
+                            if (k == 0) {
+                                physical_tag[dim][tag] = physical;
+                            }
+                        }
+                        if (dim > 0) {
+                            auto num_bounding = in.size();
+                            for (std::size_t k = 0; k < num_bounding; ++k) {
+                                in.integer();
+                            }
+                        }
+                    }
+                }
+            } else if (name == "Nodes") {
+                has_nodes = true;
+                auto num_blocks = in.size();
+                nnodes = in.size();
+                in.size(); // minNodeTag
+                max_node_tag = in.size();
+                for (std::size_t b = 0; b < num_blocks; ++b) {
+                    auto entity_dim = in.integer();
+                    in.integer(); // entityTag
+                    auto parametric = in.integer();
+                    auto count = in.size();
+                    if (entity_dim < 0 or entity_dim > 3) {
+                        in.malformed = true;
+                        break;
+                    }
+                    std::size_t num_parametric = parametric ? entity_dim : 0;
+                    auto first = node_pieces.empty()
+                                     ? 0
+                                     : node_pieces.back().first +
+                                           node_pieces.back().count;
+                    // the tags of a block precede its coordinates
+                    std::vector<const char *> tags;
+                    if (not format.binary) {
+                        in.p = _next_line(in.p, end);
+                    }
+                    for (std::size_t k = 0; k < count; k += _max_piece) {
+                        tags.push_back(in.p);
+                        auto n = std::min(_max_piece, count - k);
+                        if (format.binary) {
+                            in.p += n * format.size_bytes;
+                        } else {
+                            for (std::size_t i = 0; i < n; ++i) {
+                                in.p = _next_line(in.p, end);
+                            }
+                        }
+                    }
+                    for (std::size_t k = 0; k < count; k += _max_piece) {
+                        auto n = std::min(_max_piece, count - k);
+                        node_pieces.push_back({tags[k / _max_piece], in.p,
+                                               first + k, n, num_parametric});
+                        if (format.binary) {
+                            in.p += n * (3 + num_parametric) * sizeof(double);
+                        } else {
+                            for (std::size_t i = 0; i < n; ++i) {
+                                in.p = _next_line(in.p, end);
+                            }
+                        }
+                    }
+                    if (in.p > end) {
+                        std::cerr << "Truncated $Nodes section" << std::endl;
+                        return -1;
+                    }
+                }
+            } else if (name == "Elements") {
+                has_elements = true;
+                auto num_blocks = in.size();
+                in.size(); // numElements
+                in.size(); // minElementTag
+                in.size(); // maxElementTag
+                for (std::size_t b = 0; b < num_blocks; ++b) {
+                    auto entity_dim = in.integer();
+                    auto entity_tag = in.integer();
+                    auto gmsh_type = in.integer();
+                    auto count = in.size();
+                    if (entity_dim < 0 or entity_dim > 3) {
+                        in.malformed = true;
+                        break;
+                    }
+                    auto num_nodes = _gmsh_num_nodes(gmsh_type);
+                    if (format.binary and num_nodes == 0) {
+                        std::cerr << "Unknown gmsh element type: "
+                                  << gmsh_type << std::endl;
+                        return -1;
+                    }
+                    auto t = gmsh_type < 0 ? num_types
+                                           : _gmsh_element_type<D>(gmsh_type);
+                    I id = entity_tag;
+                    if (type == MshGenerator::GMSH) {
+                        auto it = physical_tag[entity_dim].find(entity_tag);
+                        id = it == physical_tag[entity_dim].end() ? 0
+                                                                  : it->second;
+                    }
+                    auto stride = (1 + num_nodes) * format.size_bytes;
+                    if (not format.binary) {
+                        in.p = _next_line(in.p, end);
+                    }
+                    for (std::size_t k = 0; k < count; k += _max_piece) {
+                        auto n = std::min(_max_piece, count - k);
+                        if (t < num_types) {
+                            element_pieces.push_back(
+                                {in.p, t, num_elements[t], n, stride, id});
+                            num_elements[t] += n;
+                        }
+                        if (format.binary) {
+                            in.p += n * stride;
+                        } else {
+                            for (std::size_t i = 0; i < n; ++i) {
+                                in.p = _next_line(in.p, end);
+                            }
+                        }
+                    }
+                    if (in.p > end) {
+                        std::cerr << "Truncated $Elements section"
+                                  << std::endl;
+                        return -1;
+                    }
+                }
+            }
+            if (in.malformed) {
+                std::cerr << "Malformed $" << name << " section" << std::endl;
+                return -1;
+            }
+            in.p = _next_line(
+                _section_end(in.p, end, "$End" + name), end);
+        }
+        if (not has_nodes or not has_elements) {
+            std::cerr << "Missing $Nodes or $Elements section" << std::endl;
+            return -1;
+        }
+
+        //
+        // nodes, in file order; node_index maps a node tag to its index, or
+        // to no_node if no block defines it
+        //
+        auto &node_coordinates = mesh.nodes();
+        node_coordinates.resize(nnodes * D);
+        const I no_node = std::numeric_limits<I>::max();
+        std::vector<I> node_index(max_node_tag + 1, no_node);
+        std::atomic<bool> malformed{false};
+        parallel::for_each_chunk(
+            node_pieces.size(), num_threads,
+            [&](std::size_t piece_begin, std::size_t piece_end, std::size_t) {
+                for (auto k = piece_begin; k < piece_end; ++k) {
+                    const auto &piece = node_pieces[k];
+                    _MshStream tags{piece.tags, end, format};
+                    for (std::size_t i = 0; i < piece.count; ++i) {
+                        auto tag = tags.size();
+                        if (tag <= max_node_tag) {
+                            node_index[tag] = piece.first + i;
+                        } else {
+                            tags.malformed = true;
+                        }
+                    }
+                    if (tags.malformed) {
+                        malformed = true;
+                    }
+                    auto x = node_coordinates.begin() + piece.first * D;
+                    if (D == 3 and format.binary and not format.swap and
+                        piece.num_parametric == 0) {
+                        std::memcpy(&*x, piece.coordinates,
+                                    piece.count * 3 * sizeof(double));
+                        continue;
+                    }
+                    _MshStream xyz{piece.coordinates, end, format};
+                    for (std::size_t i = 0; i < piece.count; ++i) {
+                        for (int d = 0; d < 3; ++d) {
+                            auto value = xyz.real();
+                            if (d < D) {
+                                x[i * D + d] = value;
+                            }
+                        }
+                        for (std::size_t d = 0; d < piece.num_parametric; ++d) {
+                            xyz.real();
+                        }
+                    }
+                    if (xyz.malformed) {
+                        malformed = true;
+                    }
+                }
+            });
+        if (malformed) {
+            std::cerr << "Malformed $Nodes section" << std::endl;
+            return -1;
+        }
+
+        //
+        // elements, grouped by FiniteElementType as in type_offset()
+        //
+        num_elements[vertex_type] += nnodes;
+        auto &type_offset = mesh.type_offset();
+        type_offset.assign(1, 0);
+        std::vector<std::size_t> data_begin(num_types + 1, 0);
+        std::vector<int> num_vertices(num_types);
+        for (std::size_t t = 0; t < num_types; ++t) {
+            num_vertices[t] =
+                _num_vertices<D>(static_cast<FiniteElementType>(t));
+            type_offset.push_back(type_offset.back() + num_elements[t]);
+            data_begin[t + 1] =
+                data_begin[t] + num_elements[t] * num_vertices[t];
+        }
+        auto &[element_info, element_ID] = mesh.elements();
+        auto &offset = element_info.offset();
+        auto &data = element_info.data();
+        offset.resize(type_offset.back() + 1);
+        data.resize(data_begin.back());
+        element_ID.assign(type_offset.back(), 0);
+        offset[0] = 0;
+        for (std::size_t t = 0; t < num_types; ++t) {
+            for (auto row = type_offset[t]; row < type_offset[t + 1]; ++row) {
+                offset[row + 1] =
+                    data_begin[t] +
+                    (row - type_offset[t] + 1) * num_vertices[t];
+            }
+        }
+        // one Vertex element per node
+        std::iota(data.begin(), data.begin() + nnodes, static_cast<I>(0));
+
+        parallel::for_each_chunk(
+            element_pieces.size(), num_threads,
+            [&](std::size_t piece_begin, std::size_t piece_end, std::size_t) {
+                for (auto k = piece_begin; k < piece_end; ++k) {
+                    const auto &piece = element_pieces[k];
+                    auto first = type_offset[piece.type] + piece.first +
+                                 (piece.type == vertex_type ? nnodes : 0);
+                    _MshStream in{piece.p, end, format};
+                    for (std::size_t i = 0; i < piece.count; ++i) {
+                        auto row = first + i;
+                        element_ID[row] = piece.id;
+                        auto node_list = data.begin() + offset[row];
+                        in.size(); // elementTag
+                        for (int j = 0; j < num_vertices[piece.type]; ++j) {
+                            auto tag = in.size();
+                            node_list[j] =
+                                tag <= max_node_tag ? node_index[tag] : no_node;
+                            if (node_list[j] == no_node) {
+                                in.malformed = true;
+                            }
+                        }
+                        if (static_cast<FiniteElementType>(piece.type) ==
+                            FiniteElementType::Pyramid) {
+                            std::swap(node_list[2], node_list[3]);
+                        }
+                        if (not format.binary) {
+                            in.p = _next_line(in.p, end);
+                        }
+                    }
+                    if (in.malformed) {
+                        malformed = true;
+                    }
+                }
+            });
+        if (malformed) {
+            std::cerr << "Malformed $Elements section" << std::endl;
+            return -1;
+        }
+
+        return 1;
     }
-    template <int D>
-    static int _write_h5(const Mesh<D> &mesh, std::string filename) {
+
+    template <int D, typename I>
+    static int _write_h5(const Mesh<D, I> &mesh, std::string filename,
+                         HDF5File::StorageOptions storage) {
         /*
         namespace h5=HighFive;
 
@@ -266,11 +1387,28 @@ private:
 
         }
         */
-        HDF5File file(filename, "w");
+        HDF5File file(filename, "w", storage);
 
         file.write(mesh, "mesh");
         return 1;
     }
+    template <int D, typename I>
+    static int _read_h5(Mesh<D, I> &mesh, std::string filename) {
+        try {
+            HDF5File file(filename, "r");
+            if (not file.exist("mesh")) {
+                std::cerr << "Missing mesh in " << filename << std::endl;
+                return -1;
+            }
+            file.read(mesh, "mesh");
+        } catch (const HighFive::Exception &e) {
+            std::cerr << "Cannot read " << filename << ": " << e.what()
+                      << std::endl;
+            return -1;
+        }
+        return 1;
+    }
+
     template <int D>
     static constexpr int
     _num_vertices(typename ElementSpace<D>::Type element_type) {
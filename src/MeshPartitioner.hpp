@@ -3,14 +3,19 @@
 
 #include "CSRList.hpp"
 #include "ElementSpace.hpp"
+#include "Parallel.hpp"
+#include "Partitioning.hpp"
 #include "Reorder.hpp"
 #include <algorithm>
+#include <limits>
+#include <numeric>
+#include <type_traits>
 
 template <typename DerivedClass> struct MeshPartitioner {};
 
-template <template <int> typename DerivedClass, int D>
-struct MeshPartitioner<DerivedClass<D>> {
-    using Derived = DerivedClass<D>;
+template <template <int, typename> typename DerivedClass, int D, typename I>
+struct MeshPartitioner<DerivedClass<D, I>> {
+    using Derived = DerivedClass<D, I>;
 
     /*
      *
@@ -20,9 +25,13 @@ struct MeshPartitioner<DerivedClass<D>> {
      */
     MeshPartitioner(const Derived &mesh,
                     std::vector<int> periodic_bc_mapping = {})
-        : _mesh(&mesh), _pbc_mapping(std::move(periodic_bc_mapping)) {}
+        : _mesh(&mesh), _num_parts(0),
+          _pbc_mapping(std::move(periodic_bc_mapping)),
+          _ordering(reordering::Ordering::RCM),
+          _type_weights(ElementSpace<3>::all_element_types().size(), 0),
+          _balance_boundary_facets(false), _metis_objective(-1) {}
 
-    const CSRList<std::size_t> &part(const std::string &mode = "e") const {
+    const CSRList<I> &part(const std::string &mode = "e") const {
         if (mode == "e") {
             return this->_subdomain_prime_elements;
         } else if (mode == "n") {
@@ -31,18 +40,19 @@ struct MeshPartitioner<DerivedClass<D>> {
         assert(mode == "e" or mode == "n");
         return this->_subdomain_nodes;
     }
-    std::pair<std::vector<std::size_t>, std::vector<std::size_t>>
+    std::pair<std::vector<I>, std::vector<I>>
     part(std::size_t rank) const {
-        auto element_attribution = this->_subdomain_prime_elements[rank];
-        auto node_attribution = this->_subdomain_nodes[rank];
+        auto element_attribution =
+            this->_subdomain_prime_elements[rank].to_vector();
+        auto node_attribution = this->_subdomain_nodes[rank].to_vector();
         return {element_attribution, node_attribution};
     }
-    std::vector<std::size_t> part(std::size_t rank,
-                                  const std::string &mode = "e") const {
+    std::vector<I> part(std::size_t rank,
+                        const std::string &mode = "e") const {
         if (mode == "e") {
-            return _subdomain_prime_elements[rank];
+            return _subdomain_prime_elements[rank].to_vector();
         } else if (mode == "n") {
-            return _subdomain_nodes[rank];
+            return _subdomain_nodes[rank].to_vector();
         }
         return {};
     }
@@ -51,39 +61,308 @@ struct MeshPartitioner<DerivedClass<D>> {
         return _build_local_mesh(rank);
     }
 
+    /*
+     * local_mesh_data() of every rank, built concurrently on the mesh's
+     * threads. The largest partitions are started first so that the last
+     * ones to finish are small.
+     */
+    auto local_mesh_data_all() const {
+        using LocalMeshData = decltype(_build_local_mesh(0));
+        std::vector<LocalMeshData> results(_num_parts);
+        std::vector<std::size_t> order(_num_parts);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(),
+                         [this](std::size_t a, std::size_t b) {
+                             return _subdomain_prime_elements[a].size() >
+                                    _subdomain_prime_elements[b].size();
+                         });
+        // shared by all threads; built here rather than concurrently
+        _mesh->element_collections(D);
+        parallel::for_each_dynamic(
+            _num_parts, _mesh->num_threads(),
+            [&](std::size_t i, std::size_t) {
+                results[order[i]] = _build_local_mesh(order[i]);
+            });
+        return results;
+    }
+
     int num_partitions() const { return _num_parts; }
 
+    /*
+     * Installs a partitioning computed earlier, e.g. read back from a file:
+     * row r holds the prime elements and the owned nodes of rank r.
+     */
+    void set_partitions(CSRList<I> prime_elements, CSRList<I> nodes) {
+        assert(prime_elements.size() == nodes.size());
+        _num_parts = prime_elements.size();
+        _metis_objective = -1;
+        _subdomain_prime_elements = std::move(prime_elements);
+        _subdomain_nodes = std::move(nodes);
+        _index_partitions();
+    }
+
+    /*
+     * Rank of every prime element and its index in part(rank, "e"), so
+     * that per-element lookups never search a partition.
+     */
+    const std::vector<I> &element_rank() const { return _element_rank; }
+
+    const std::vector<I> &element_local_index() const {
+        return _element_local_index;
+    }
+
+    /*
+     * Owner rank of every node (the METIS node partition)
+     */
+    const std::vector<I> &node_rank() const { return _node_rank; }
+
+    /*
+     * Ordering of the local nodes in local_mesh_data(), RCM by default.
+     */
+    void set_ordering(reordering::Ordering ordering) { _ordering = ordering; }
+
+    reordering::Ordering ordering() const { return _ordering; }
+
+    /*
+     * Bandwidth and profile of the local nodal adjacency of rank when its
+     * nodes are numbered by the given ordering.
+     */
+    reordering::OrderingMetrics
+    ordering_metrics(std::size_t rank, reordering::Ordering ordering) const {
+        auto nodal_local_to_global = _collect_nodes(rank);
+        auto local_elements = _local_elements(rank, nodal_local_to_global);
+        auto nodal_connectivity = _local_vertex_connectivity(local_elements);
+        auto mapping = reordering::make_ordering(
+            ordering, nodal_connectivity,
+            _local_coordinates(nodal_local_to_global), D);
+        return reordering::metrics(nodal_connectivity, mapping);
+    }
+
+    /*
+     * Partitions the prime elements into num_parts parts with the given
+     * backend. The geometric backends cut the element centroids and give
+     * every node to the lowest rank among its elements. Fewer than one
+     * part is taken as one, as in metis().
+     */
+    void partition(std::size_t num_parts,
+                   partitioning::Method method = partitioning::Method::METIS) {
+        num_parts = std::max<std::size_t>(num_parts, 1);
+        if (method == partitioning::Method::METIS) {
+            metis(num_parts);
+            return;
+        }
+        auto centroids = _element_centroids();
+        std::vector<I> epart;
+        if (method == partitioning::Method::Hilbert) {
+            epart = partitioning::hilbert_partition<I>(centroids, D, num_parts,
+                                                       _mesh->num_threads());
+        } else {
+            epart = partitioning::RecursiveBisection<I>(
+                centroids, D, method == partitioning::Method::RIB,
+                _mesh->num_threads())(num_parts);
+        }
+        _assign_partitions(num_parts, epart, _node_partition(num_parts, epart));
+        _metis_objective = -1;
+    }
+
+    /*
+     * Cost of one element of the given type in the METIS load balance; by
+     * default its number of vertices, so that e.g. a 27-node IGA2 cell
+     * weighs almost seven tetrahedra. A weight of 0 restores the default.
+     */
+    void set_element_weight(FiniteElementType type, idx_t weight) {
+        _type_weights.at(static_cast<std::size_t>(type)) = weight;
+    }
+
+    idx_t element_weight(FiniteElementType type) const {
+        return _type_weights.at(static_cast<std::size_t>(type));
+    }
+
+    /*
+     * Balances the boundary facets of each part as a second METIS
+     * constraint besides the element weights. The dual graph is then
+     * partitioned directly and the nodes go to the lowest rank among their
+     * elements.
+     */
+    void balance_boundary_facets(bool enable = true) {
+        _balance_boundary_facets = enable;
+    }
+
+    bool boundary_facets_balanced() const { return _balance_boundary_facets; }
+
+    /*
+     * Edge cut, communication volume, balance and neighbors of the current
+     * partitioning. The ranks are analysed concurrently on the mesh's
+     * threads: each one walks the elements around its nodes, so the cost
+     * is linear in the mesh size whatever the number of parts. No
+     * connectivity is cached on the mesh besides its prime elements.
+     */
+    partitioning::Quality quality() const {
+        partitioning::Quality quality;
+        quality.num_parts = _num_parts;
+        quality.metis_objective = _metis_objective;
+        quality.elements.resize(_num_parts);
+        quality.owned_nodes.resize(_num_parts);
+        quality.ghost_nodes.resize(_num_parts);
+        quality.neighbors.resize(_num_parts);
+        if (_num_parts == 0) {
+            return quality;
+        }
+        const auto num_threads = _mesh->num_threads();
+
+        // elements sharing at least ncommon nodes are neighbors in the dual
+        // graph, as in metis()
+        idx_t ncommon = std::numeric_limits<idx_t>::max();
+        for (auto type : ElementSpace<D>::prime_element_types()) {
+            auto [begin, end] = _mesh->type_offset(type);
+            if (end > begin) {
+                ncommon = std::min<idx_t>(
+                    ncommon, ElementSpace<D>::min_facet_vertices(type));
+            }
+        }
+
+        // nodes shared with each neighbor; pairs are counted by their lower
+        // rank, cut dual graph edges by both of their elements. {0, D} is
+        // used if the mesh has it, otherwise built here and dropped on
+        // return, so a report does not leave it cached.
+        const auto &elements = _mesh->element_collections(D);
+        CSRList<I> local_node_elements;
+        if (not _mesh->is_built(0, D)) {
+            local_node_elements = elements.reverse(num_threads);
+        }
+        const auto &node_elements = _mesh->is_built(0, D)
+                                        ? _mesh->connectivity(0, D)
+                                        : local_node_elements;
+        std::vector<std::vector<std::size_t>> interfaces(_num_parts);
+        std::vector<std::size_t> cut(_num_parts, 0);
+        parallel::for_each_dynamic(
+            _num_parts, num_threads, [&](std::size_t rank, std::size_t) {
+                std::vector<I> around;
+                for (auto element : _subdomain_prime_elements[rank]) {
+                    around.clear();
+                    for (auto node : elements[element]) {
+                        for (auto other : node_elements[node]) {
+                            if (_element_rank[other] != rank) {
+                                around.push_back(other);
+                            }
+                        }
+                    }
+                    std::sort(around.begin(), around.end());
+                    for (std::size_t i = 0, j = 0; i < around.size(); i = j) {
+                        while (j < around.size() and around[j] == around[i]) {
+                            ++j;
+                        }
+                        cut[rank] += static_cast<idx_t>(j - i) >= ncommon;
+                    }
+                }
+
+                auto nodes = _collect_nodes(rank);
+                std::vector<I> other_ranks;
+                std::size_t ghosts = 0;
+                for (auto node : nodes) {
+                    ghosts += _node_rank[node] != rank;
+                    auto first = other_ranks.size();
+                    for (auto element : node_elements[node]) {
+                        if (_element_rank[element] != rank) {
+                            other_ranks.push_back(_element_rank[element]);
+                        }
+                    }
+                    std::sort(other_ranks.begin() + first, other_ranks.end());
+                    other_ranks.erase(std::unique(other_ranks.begin() + first,
+                                                  other_ranks.end()),
+                                      other_ranks.end());
+                }
+                std::sort(other_ranks.begin(), other_ranks.end());
+                std::size_t num_neighbors = 0;
+                for (std::size_t i = 0, j = 0; i < other_ranks.size(); i = j) {
+                    while (j < other_ranks.size() and
+                           other_ranks[j] == other_ranks[i]) {
+                        ++j;
+                    }
+                    ++num_neighbors;
+                    if (other_ranks[i] > rank) {
+                        interfaces[rank].push_back(j - i);
+                    }
+                }
+                quality.elements[rank] = _subdomain_prime_elements[rank].size();
+                quality.owned_nodes[rank] = _subdomain_nodes[rank].size();
+                quality.ghost_nodes[rank] = ghosts;
+                quality.neighbors[rank] = num_neighbors;
+            });
+
+        quality.edge_cut = std::accumulate(cut.begin(), cut.end(),
+                                           static_cast<std::size_t>(0)) /
+                           2;
+        quality.communication_volume =
+            std::accumulate(quality.ghost_nodes.begin(),
+                            quality.ghost_nodes.end(),
+                            static_cast<std::size_t>(0));
+        auto num_elements = std::accumulate(quality.elements.begin(),
+                                            quality.elements.end(),
+                                            static_cast<std::size_t>(0));
+        if (num_elements) {
+            quality.element_imbalance =
+                static_cast<double>(*std::max_element(quality.elements.begin(),
+                                                      quality.elements.end())) *
+                _num_parts / num_elements;
+        }
+        auto &histogram = quality.interface_histogram;
+        for (const auto &sizes : interfaces) {
+            for (auto size : sizes) {
+                std::size_t bin = 0;
+                while (size >> (bin + 1)) {
+                    ++bin;
+                }
+                if (histogram.size() <= bin) {
+                    histogram.resize(bin + 1, 0);
+                }
+                ++histogram[bin];
+            }
+        }
+        return quality;
+    }
+
     void metis(idx_t num_parts = 4) {
-        _num_parts = num_parts;
         // calculate numbers of nodes and elements
         idx_t num_nodes = _mesh->nodes().size() / D;
-        const auto &elements = _mesh->elements();
         const auto prime_element_type = ElementSpace<D>().prime_element_types();
-        CSRList<std::size_t> prime_element_list;
+        CSRList<I> prime_element_list;
+        // elements sharing a facet are neighbors in the dual graph
+        idx_t ncommon = std::numeric_limits<idx_t>::max();
+        std::vector<idx_t> element_weights;
         std::for_each(prime_element_type.begin(), prime_element_type.end(),
                       [&](FiniteElementType type) {
-                          prime_element_list +=
-                              std::move(this->_mesh->elements(type).first);
+                          auto elements = this->_mesh->elements(type).first;
+                          if (elements.size()) {
+                              ncommon = std::min<idx_t>(
+                                  ncommon,
+                                  ElementSpace<D>::min_facet_vertices(type));
+                          }
+                          for (auto element : elements) {
+                              auto weight = element_weight(type);
+                              element_weights.push_back(
+                                  weight > 0 ? weight : element.size());
+                          }
+                          prime_element_list += std::move(elements);
                       });
         idx_t num_elements = prime_element_list.size();
-        std::vector<std::vector<idx_t>> _element_partitioning;
-        std::vector<std::vector<idx_t>> _node_partitioning;
-        _element_partitioning.resize(_num_parts);
-        _node_partitioning.resize(_num_parts);
-
-        if (_num_parts >= 2) {
-            std::vector<idx_t> element_array(prime_element_list.data().begin(),
-                                             prime_element_list.data().end());
-            std::vector<idx_t> element_offset(
-                prime_element_list.offset().begin(),
-                prime_element_list.offset().end());
-
-            idx_t *vwgt = nullptr;
+        // buffer for element and node attributions
+        std::vector<idx_t> epart(num_elements, 0), npart(num_nodes, 0);
+        idx_t objval = 0;
+
+        if (num_parts >= 2) {
+            std::vector<idx_t> element_array_buffer, element_offset_buffer;
+            auto element_array =
+                _as_idx_array(prime_element_list.data(), element_array_buffer);
+            auto element_offset = _as_idx_array(prime_element_list.offset(),
+                                                element_offset_buffer);
+
             idx_t *vsize = nullptr;
-            idx_t ncommon = 1;
+            if (ncommon == std::numeric_limits<idx_t>::max()) {
+                ncommon = 1;
+            }
 
             real_t *tpwgts = nullptr;
-            idx_t objval = 1;
 
             idx_t options[METIS_NOPTIONS];
             METIS_SetDefaultOptions(options);
@@ -99,49 +378,176 @@ struct MeshPartitioner<DerivedClass<D>> {
             options[METIS_OPTION_SEED] = -1;
             options[METIS_OPTION_NITER] = 10;
             options[METIS_OPTION_NCUTS] = 1;
-            // buffer for element and node attributions
-            std::vector<idx_t> epart(num_elements), npart(num_nodes);
-            auto status = METIS_PartMeshDual(
-                &num_elements, &num_nodes,
-                // mesh.eptr.data(), mesh.eind.data(),
-                element_offset.data(), element_array.data(), vwgt, vsize,
-                &ncommon, &num_parts, tpwgts, options, &objval, epart.data(),
-                npart.data());
-            assert(status == METIS_OK);
-            for (std::size_t i = 0; i < epart.size(); ++i) {
-                auto rank = epart[i];
-                _element_partitioning[rank].push_back(i);
-            }
-            for (std::size_t i = 0; i < npart.size(); ++i) {
-                auto rank = npart[i];
-                _node_partitioning[rank].push_back(i);
+            auto facet_weights = _balance_boundary_facets
+                                     ? _boundary_facet_counts()
+                                     : std::vector<idx_t>();
+            if (std::any_of(facet_weights.begin(), facet_weights.end(),
+                            [](idx_t w) { return w > 0; })) {
+                // multi-constraint: {element weight, boundary facets}
+                idx_t ncon = 2;
+                std::vector<idx_t> vwgt(num_elements * ncon);
+                for (idx_t i = 0; i < num_elements; ++i) {
+                    vwgt[i * ncon] = element_weights[i];
+                    vwgt[i * ncon + 1] = facet_weights[i];
+                }
+                idx_t numflag = 0;
+                idx_t *xadj = nullptr, *adjncy = nullptr;
+                auto status =
+                    METIS_MeshToDual(&num_elements, &num_nodes, element_offset,
+                                     element_array, &ncommon, &numflag, &xadj,
+                                     &adjncy);
+                assert(status == METIS_OK);
+                status = METIS_PartGraphKway(
+                    &num_elements, &ncon, xadj, adjncy, vwgt.data(), vsize,
+                    nullptr, &num_parts, tpwgts, nullptr, options, &objval,
+                    epart.data());
+                assert(status == METIS_OK);
+                METIS_Free(xadj);
+                METIS_Free(adjncy);
+                npart = _node_partition(num_parts, epart);
+            } else {
+                auto status = METIS_PartMeshDual(
+                    &num_elements, &num_nodes,
+                    // mesh.eptr.data(), mesh.eind.data(),
+                    element_offset, element_array, element_weights.data(),
+                    vsize, &ncommon, &num_parts, tpwgts, options, &objval,
+                    epart.data(), npart.data());
+                assert(status == METIS_OK);
             }
-        } else {
-            std::iota(_element_partitioning[0].begin(),
-                      _element_partitioning[0].end(), 0);
-            std::iota(_node_partitioning[0].begin(),
-                      _node_partitioning[0].end(), 0);
         }
-
-        // store partitioning results in CSRList
-        std::for_each(_element_partitioning.begin(),
-                      _element_partitioning.end(), [this](const auto &e) {
-                          this->_subdomain_prime_elements.push_back(e);
-                      });
-        std::for_each(
-            _node_partitioning.begin(), _node_partitioning.end(),
-            [this](const auto &e) { this->_subdomain_nodes.push_back(e); });
+        _assign_partitions(std::max<idx_t>(num_parts, 1), epart, npart);
+        _metis_objective = objval;
     }
     // renumbering
 private:
-    std::vector<std::size_t> _collect_nodes(std::size_t rank) const {
-        auto local_elements = this->_subdomain_prime_elements[rank];
-        auto local_nodes = this->_subdomain_nodes[rank];
+    /*
+     * Stores the partitions given the rank of every prime element and of
+     * every node.
+     */
+    template <typename Part>
+    void _assign_partitions(std::size_t num_parts,
+                            const std::vector<Part> &epart,
+                            const std::vector<Part> &npart) {
+        _num_parts = num_parts;
+        std::vector<std::vector<I>> element_partitioning(num_parts);
+        std::vector<std::vector<I>> node_partitioning(num_parts);
+        for (std::size_t i = 0; i < epart.size(); ++i) {
+            element_partitioning[epart[i]].push_back(i);
+        }
+        for (std::size_t i = 0; i < npart.size(); ++i) {
+            node_partitioning[npart[i]].push_back(i);
+        }
+
+        // store partitioning results in CSRList
+        _subdomain_prime_elements = CSRList<I>();
+        _subdomain_nodes = CSRList<I>();
+        for (const auto &e : element_partitioning) {
+            _subdomain_prime_elements.push_back(e);
+        }
+        for (const auto &n : node_partitioning) {
+            _subdomain_nodes.push_back(n);
+        }
+        _index_partitions();
+    }
+
+    std::vector<double> _element_centroids() const {
+        const auto &elements = _mesh->element_collections(D);
+        const auto &nodes = _mesh->nodes();
+        std::vector<double> centroids(elements.size() * D, 0.0);
+        parallel::for_each_chunk(
+            elements.size(), _mesh->num_threads(),
+            [&](std::size_t begin, std::size_t end, std::size_t) {
+                for (auto i = begin; i < end; ++i) {
+                    auto vertices = elements[i];
+                    for (auto v : vertices) {
+                        for (int d = 0; d < D; ++d) {
+                            centroids[i * D + d] += nodes[v * D + d];
+                        }
+                    }
+                    for (int d = 0; d < D; ++d) {
+                        centroids[i * D + d] /= vertices.size();
+                    }
+                }
+            });
+        return centroids;
+    }
+
+    // every node goes to the lowest rank among its prime elements
+    template <typename Part>
+    std::vector<Part> _node_partition(std::size_t num_parts,
+                                      const std::vector<Part> &epart) const {
+        const auto &elements = _mesh->element_collections(D);
+        std::vector<Part> npart(_mesh->nodes().size() / D, num_parts);
+        for (std::size_t i = 0; i < elements.size(); ++i) {
+            for (auto v : elements[i]) {
+                npart[v] = std::min(npart[v], epart[i]);
+            }
+        }
+        for (auto &rank : npart) {
+            if (rank == static_cast<Part>(num_parts)) {
+                rank = 0;
+            }
+        }
+        return npart;
+    }
+
+    // number of facets of each prime element that belong to no other one
+    std::vector<idx_t> _boundary_facet_counts() const {
+        const auto &facet_elements = _mesh->connectivity(D - 1, D);
+        std::vector<idx_t> counts(_mesh->element_collections(D).size(), 0);
+        for (auto elements : facet_elements) {
+            if (elements.size() == 1) {
+                ++counts[elements[0]];
+            }
+        }
+        return counts;
+    }
+
+    void _index_partitions() {
+        std::size_t num_nodes = std::max(_mesh->nodes().size() / D,
+                                         _subdomain_nodes.data().size());
+        _node_rank.assign(num_nodes, 0);
+        for (std::size_t rank = 0; rank < _subdomain_nodes.size(); ++rank) {
+            for (auto node : _subdomain_nodes[rank]) {
+                _node_rank[node] = rank;
+            }
+        }
+        std::size_t num_elements = _subdomain_prime_elements.data().size();
+        _element_rank.assign(num_elements, 0);
+        _element_local_index.assign(num_elements, 0);
+        for (std::size_t rank = 0; rank < _subdomain_prime_elements.size();
+             ++rank) {
+            auto elements = _subdomain_prime_elements[rank];
+            for (std::size_t i = 0; i < elements.size(); ++i) {
+                _element_rank[elements[i]] = rank;
+                _element_local_index[elements[i]] = i;
+            }
+        }
+    }
+
+    /*
+     * METIS only reads the mesh arrays, so when the index type has the same
+     * representation as idx_t the storage is handed over without a copy;
+     * otherwise it is converted into buffer.
+     */
+    template <typename T>
+    static idx_t *_as_idx_array(std::vector<T> &array,
+                                std::vector<idx_t> &buffer) {
+        if constexpr (std::is_integral_v<T> and
+                      std::is_same_v<std::make_signed_t<T>, idx_t>) {
+            return reinterpret_cast<idx_t *>(array.data());
+        } else {
+            buffer.assign(array.begin(), array.end());
+            return buffer.data();
+        }
+    }
 
-        std::vector<std::size_t> all_local_nodes;
-        all_local_nodes.reserve(_mesh->elements().first.size() * 4);
+    std::vector<I> _collect_nodes(std::size_t rank) const {
         auto element_local_to_global = this->_subdomain_prime_elements[rank];
-        auto elements = _mesh->elements(D).first;
+        const auto &elements = _mesh->element_collections(D);
+
+        std::vector<I> all_local_nodes;
+        all_local_nodes.reserve(element_local_to_global.size() * 4);
         for (auto ielem : element_local_to_global) {
             auto element_vertices = elements[ielem];
             all_local_nodes.insert(all_local_nodes.end(),
@@ -156,40 +562,31 @@ private:
     }
 
     typedef int ghosted_type;
+    // nodes owned by another rank are ghosted
     std::vector<ghosted_type>
     _find_ghosted_node(size_t rank,
-                       const std::vector<std::size_t> &nodes) const {
-
-        // auto sorted =
-        //     std::all_of(nodes.cbegin(), nodes.cend() - 1,
-        //                 [](const std::size_t &n) { return n < *(&n + 1); });
-        // assert(sorted);
-
-        std::vector<ghosted_type> ghosted(nodes.size(), 0);
-        auto owned_local_nodes = this->_subdomain_nodes[rank];
+                       const std::vector<I> &nodes) const {
 
-        std::sort(owned_local_nodes.begin(), owned_local_nodes.end());
-
-        for (auto it = nodes.cbegin(); it != nodes.cend(); ++it) {
-            auto it_owned = std::find(owned_local_nodes.cbegin(),
-                                      owned_local_nodes.cend(), *it);
-            auto key = std::distance(nodes.cbegin(), it);
-            auto value = it_owned == owned_local_nodes.cend();
-            ghosted[key] = value;
+        std::vector<ghosted_type> ghosted(nodes.size());
+        for (std::size_t i = 0; i < nodes.size(); ++i) {
+            ghosted[i] = _node_rank[nodes[i]] != rank;
         }
 
         return ghosted;
     }
 
-    CSRList<std::size_t, std::size_t, std::false_type>
-    _local_vertex_connectivity(const CSRList<std::size_t> &elements) const {
+    CSRList<I, I, std::false_type>
+    _local_vertex_connectivity(const CSRList<I> &elements) const {
         // elements should use local node ID
-        auto nnode = *std::max_element(elements.data().cbegin(),
-                                       elements.data().cend()) +
-                     1;
+        std::size_t nnode =
+            elements.data().empty()
+                ? 0
+                : *std::max_element(elements.data().cbegin(),
+                                    elements.data().cend()) +
+                      1;
         std::size_t expected_bandwidth = 24;
 
-        std::vector<std::vector<std::size_t>> adjacency(nnode);
+        std::vector<std::vector<I>> adjacency(nnode);
         for (auto &cache : adjacency) {
             cache.reserve(expected_bandwidth);
         }
@@ -197,14 +594,14 @@ private:
         for (auto cell : elements) {
             const auto &vertex_list = cell.data();
             std::for_each(vertex_list.cbegin(), vertex_list.cend(),
-                          [&](std::size_t ivtx) {
+                          [&](I ivtx) {
                               adjacency.at(ivtx).insert(
                                   adjacency.at(ivtx).end(),
                                   vertex_list.cbegin(), vertex_list.cend());
                           });
         }
 
-        CSRList<std::size_t, std::size_t, std::false_type> local_graph;
+        CSRList<I, I, std::false_type> local_graph;
         for (auto &cache : adjacency) {
             // remove duplicated entries
             std::sort(cache.begin(), cache.end());
@@ -213,42 +610,69 @@ private:
         }
         return local_graph;
     }
+    std::unordered_map<I, I>
+    _global_to_local(const std::vector<I> &nodal_local_to_global) const {
+        std::unordered_map<I, I> g2l;
+        g2l.reserve(nodal_local_to_global.size());
+        for (std::size_t inode = 0; inode < nodal_local_to_global.size();
+             ++inode) {
+            g2l.insert({nodal_local_to_global[inode], inode});
+        }
+        return g2l;
+    }
+
+    // prime elements of rank using local nodal ID
+    CSRList<I>
+    _local_elements(std::size_t rank,
+                    const std::vector<I> &nodal_local_to_global) const {
+        auto g2l = _global_to_local(nodal_local_to_global);
+        CSRList<I> local_elements;
+        auto element_local_to_global = this->_subdomain_prime_elements[rank];
+        const auto &elements = _mesh->element_collections(D);
+        for (auto ielem : element_local_to_global) {
+            local_elements.push_back(elements[ielem]);
+        }
+        std::for_each(local_elements.data().begin(),
+                      local_elements.data().end(),
+                      [&](I &a) { a = g2l[a]; });
+        return local_elements;
+    }
+
+    std::vector<double>
+    _local_coordinates(const std::vector<I> &nodal_local_to_global) const {
+        const auto &nodes = _mesh->nodes();
+        std::vector<double> coordinates;
+        coordinates.reserve(nodal_local_to_global.size() * D);
+        for (auto inode : nodal_local_to_global) {
+            coordinates.insert(coordinates.end(), nodes.begin() + inode * D,
+                               nodes.begin() + (inode + 1) * D);
+        }
+        return coordinates;
+    }
+
     auto _build_local_mesh(std::size_t rank) const {
 
         //
         // global to local mapping
         //
         auto nodal_local_to_global = _collect_nodes(rank);
-        auto num_all_nodes = nodal_local_to_global.size();
-        std::unordered_map<std::size_t, std::size_t> g2l;
-        g2l.reserve(nodal_local_to_global.size());
-        for (std::size_t inode = 0; inode < num_all_nodes; ++inode) {
-            g2l.insert({nodal_local_to_global[inode], inode});
-        }
+        auto g2l = _global_to_local(nodal_local_to_global);
 
         //
         // elements using local nodal ID
         //
-        CSRList<std::size_t> local_elements;
         auto element_local_to_global = this->_subdomain_prime_elements[rank];
-        auto elements = _mesh->elements(D).first;
-        for (auto ielem : element_local_to_global) {
-            auto vertices = elements[ielem];
-            local_elements.push_back(vertices);
-        }
-        // return std::make_tuple(0, 0, 0);
-
-        std::for_each(local_elements.data().begin(),
-                      local_elements.data().end(),
-                      [&](std::size_t &a) { a = g2l[a]; });
+        auto local_elements = _local_elements(rank, nodal_local_to_global);
 
         // build an old-to-new mapping
         //
         //	vertex connectivity
         //
         auto nodal_connectivity = _local_vertex_connectivity(local_elements);
-        // use Reverse Cuthill-Mckee to reorder the vertices
-        auto mapping = reordering::BandwidthReduction(nodal_connectivity)();
+        // reorder the vertices, Reverse Cuthill-Mckee by default
+        auto mapping = reordering::make_ordering(
+            _ordering, nodal_connectivity,
+            _local_coordinates(nodal_local_to_global), D);
 
         {
             auto n_l2g = nodal_local_to_global;
@@ -280,14 +704,14 @@ private:
         }
 
         return std::make_tuple(nodal_local_to_global, is_ghosted,
-                               this->_subdomain_prime_elements[rank]);
+                               element_local_to_global.to_vector());
     }
     [[deprecated]] auto _build_local_mesh_deprecated(std::size_t rank) const {
         //
         // global to local mapping
         //
         auto nodal_local_to_global = _collect_nodes(rank);
-        std::unordered_map<std::size_t, std::size_t> g2l;
+        std::unordered_map<I, I> g2l;
         g2l.reserve(nodal_local_to_global.size());
         for (std::size_t inode = 0; inode < nodal_local_to_global.size();
              ++inode) {
@@ -297,7 +721,7 @@ private:
         //
         // elements using local nodal ID
         //
-        CSRList<std::size_t> local_elements;
+        CSRList<I> local_elements;
         auto element_local_to_global = this->_subdomain_prime_elements[rank];
         auto elements = _mesh->elements(D).first;
         for (auto ielem : element_local_to_global) {
@@ -308,14 +732,15 @@ private:
 
         std::for_each(local_elements.data().begin(),
                       local_elements.data().end(),
-                      [&](std::size_t &a) { a = g2l[a]; });
+                      [&](I &a) { a = g2l[a]; });
 
         // build an old-to-new mapping
         //
         //	vertex connectivity
         //
         auto nodal_connectivity = _local_vertex_connectivity(local_elements);
-        auto mapping = reordering::BandwidthReduction(nodal_connectivity)();
+        auto mapping =
+            reordering::BandwidthReduction<I>(nodal_connectivity, true)();
 
         // permute to ensure ghosted nodes come last
         auto ghosted = _find_ghosted_node(rank, nodal_local_to_global);
@@ -355,7 +780,7 @@ private:
             // squeezed_mapping.end(), 32310); printf("distance %zu\n",
             // std::distance(squeezed_mapping.begin(), it));
             ;
-            std::unordered_map<std::size_t, std::size_t> old_ID_to_new;
+            std::unordered_map<I, I> old_ID_to_new;
             old_ID_to_new.reserve(squeezed_mapping.size());
             for (std::size_t i = 0; i < squeezed_mapping.size(); ++i) {
                 old_ID_to_new.insert({squeezed_mapping[i], i});
@@ -388,7 +813,7 @@ private:
         //
         // permute vertices
         //
-        std::vector<std::size_t> nodal_local_to_global_tmp(
+        std::vector<I> nodal_local_to_global_tmp(
             nodal_local_to_global.size());
         for (std::size_t inode = 0; inode != nodal_local_to_global.size();
              ++inode) {
@@ -416,14 +841,14 @@ private:
         //
         std::for_each(local_elements.data().begin(),
                       local_elements.data().end(),
-                      [&](std::size_t &a) { a = mapping[a]; });
+                      [&](I &a) { a = mapping[a]; });
 
         //
         // vertex adjacency
         //
 
-        CSRList<std::size_t, std::size_t, std::false_type> local_adjacency;
-        auto graph = this->_mesh->adjacent_vertices();
+        CSRList<I, I, std::false_type> local_adjacency;
+        const auto &graph = this->_mesh->adjacent_vertices();
         for (std::size_t i = 0; i != nodal_local_to_global.size(); ++i) {
             local_adjacency.push_back(graph[nodal_local_to_global[i]]);
         }
@@ -436,13 +861,24 @@ private:
 
     const Derived *_mesh;
     std::size_t _num_parts;
-    CSRList<std::size_t> _subdomain_prime_elements;
+    CSRList<I> _subdomain_prime_elements;
     // parititioning secondary elements should also happen here,
     // while currently it does not,
     // so _subdomain_secondary_elements is empty;
-    CSRList<std::size_t> _subdomain_secondary_elements;
-    CSRList<std::size_t> _subdomain_nodes;
+    CSRList<I> _subdomain_secondary_elements;
+    CSRList<I> _subdomain_nodes;
+    // prime element -> (rank, index in _subdomain_prime_elements[rank])
+    std::vector<I> _element_rank;
+    std::vector<I> _element_local_index;
+    // node -> owner rank
+    std::vector<I> _node_rank;
 
     std::vector<int> _pbc_mapping;
+    reordering::Ordering _ordering;
+    // METIS weight of each element type, 0 for the number of vertices
+    std::vector<idx_t> _type_weights;
+    bool _balance_boundary_facets;
+    // METIS objective of the last partitioning, -1 if not METIS
+    long _metis_objective;
 };
 #endif // __MESH_PARTITIONER_H__
@@ -0,0 +1,224 @@
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace parallel {
+
+inline std::size_t default_num_threads() {
+    auto n = std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+/**
+ * @brief first index of chunk i when [0, n) is split into num_chunks
+ * contiguous, nearly equal chunks
+ */
+inline std::size_t chunk_begin(std::size_t n, std::size_t num_chunks,
+                               std::size_t i) {
+    return n / num_chunks * i + std::min(i, n % num_chunks);
+}
+
+/**
+ * @brief the first exception thrown by the threads of a parallel loop, to
+ * be rethrown on the calling thread once they are all joined
+ */
+class FirstException {
+public:
+    // to be called from a catch block
+    void capture() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (not _error) {
+            _error = std::current_exception();
+        }
+    }
+
+    void rethrow() const {
+        if (_error) {
+            std::rethrow_exception(_error);
+        }
+    }
+
+private:
+    std::mutex _mutex;
+    std::exception_ptr _error;
+};
+
+/**
+ * @brief split [0, n) into contiguous chunks and call
+ * func(begin, end, chunk_id) on each of them concurrently.
+ * The calling thread processes chunk 0. At most num_threads chunks are
+ * created and never more than n, so chunk_id can index per-thread buffers.
+ * If func throws, the other chunks still run to completion, all threads are
+ * joined and the first exception is rethrown on the calling thread.
+ */
+template <typename Func>
+std::size_t for_each_chunk(std::size_t n, std::size_t num_threads,
+                           Func &&func) {
+    num_threads = std::max<std::size_t>(1, std::min(num_threads, n));
+    if (num_threads == 1) {
+        func(std::size_t(0), n, std::size_t(0));
+        return 1;
+    }
+    FirstException error;
+    auto work = [&](std::size_t t) {
+        try {
+            func(chunk_begin(n, num_threads, t),
+                 chunk_begin(n, num_threads, t + 1), t);
+        } catch (...) {
+            error.capture();
+        }
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(num_threads - 1);
+    try {
+        for (std::size_t t = 1; t < num_threads; ++t) {
+            workers.emplace_back(work, t);
+        }
+    } catch (...) {
+        error.capture();
+    }
+    work(0);
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    error.rethrow();
+    return num_threads;
+}
+
+/**
+ * @brief call func(i, thread_id) for every i in [0, n) on num_threads
+ * threads. Each thread takes the next index from a shared counter, so
+ * uneven work items balance themselves; items are started in index order.
+ * The calling thread is thread 0.
+ * If func throws, the other threads stop after their current item, all
+ * threads are joined and the first exception is rethrown on the calling
+ * thread.
+ */
+template <typename Func>
+void for_each_dynamic(std::size_t n, std::size_t num_threads, Func &&func) {
+    num_threads = std::max<std::size_t>(1, std::min(num_threads, n));
+    std::atomic<std::size_t> next(0);
+    FirstException error;
+    auto work = [&](std::size_t t) {
+        try {
+            for (auto i = next++; i < n; i = next++) {
+                func(i, t);
+            }
+        } catch (...) {
+            error.capture();
+            next = n;
+        }
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(num_threads - 1);
+    try {
+        for (std::size_t t = 1; t < num_threads; ++t) {
+            workers.emplace_back(work, t);
+        }
+    } catch (...) {
+        error.capture();
+        next = n;
+    }
+    work(0);
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    error.rethrow();
+}
+
+/**
+ * @brief run produce(i) for every i in [0, n) on num_threads workers that
+ * take the next index from a shared counter, and hand each result to
+ * consume(std::move(result)) on the calling thread, one at a time and in
+ * completion order. At most num_threads results wait for the consumer, so
+ * a slow consumer (e.g. a file writer that is not thread-safe) bounds the
+ * memory held by finished work.
+ * If produce or consume throws, the other workers stop after their current
+ * item, all threads are joined and the first exception is rethrown on the
+ * calling thread.
+ */
+template <typename Produce, typename Consume>
+void pipeline(std::size_t n, std::size_t num_threads, Produce &&produce,
+              Consume &&consume) {
+    num_threads = std::max<std::size_t>(1, std::min(num_threads, n));
+    if (num_threads == 1) {
+        for (std::size_t i = 0; i < n; ++i) {
+            consume(produce(i));
+        }
+        return;
+    }
+    using Result = decltype(produce(std::size_t(0)));
+    std::deque<Result> queue;
+    std::mutex mutex;
+    std::condition_variable ready, space;
+    std::atomic<std::size_t> next(0);
+    // set with the first exception; wakes up and stops everyone
+    bool stopped = false;
+    std::exception_ptr error;
+    auto stop = [&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (not error) {
+            error = std::current_exception();
+        }
+        stopped = true;
+        next = n;
+        ready.notify_all();
+        space.notify_all();
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(num_threads);
+    for (std::size_t t = 0; t < num_threads; ++t) {
+        workers.emplace_back([&]() {
+            try {
+                for (auto i = next++; i < n; i = next++) {
+                    auto result = produce(i);
+                    std::unique_lock<std::mutex> lock(mutex);
+                    space.wait(lock, [&]() {
+                        return stopped or queue.size() < num_threads;
+                    });
+                    if (stopped) {
+                        return;
+                    }
+                    queue.push_back(std::move(result));
+                    ready.notify_one();
+                }
+            } catch (...) {
+                stop();
+            }
+        });
+    }
+    try {
+        for (std::size_t consumed = 0; consumed < n; ++consumed) {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [&]() { return stopped or not queue.empty(); });
+            if (stopped) {
+                break;
+            }
+            auto result = std::move(queue.front());
+            queue.pop_front();
+            lock.unlock();
+            space.notify_one();
+            consume(std::move(result));
+        }
+    } catch (...) {
+        stop();
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+} // namespace parallel
+
+#endif // __PARALLEL_H__
@@ -18,6 +18,8 @@ public:
         return _arg_map[key].as<T>();
     }
 
+    bool has(std::string key) const { return _arg_map.count(key); }
+
 private:
     void resolve_cmd_line_args() {
         std::string input_fmt;
@@ -35,7 +37,25 @@ private:
             "output,o", po::value<std::string>(), "the output mesh file")(
             "output_fmt",
             po::value<std::string>(&output_fmt)->default_value("h5"),
-            "format of the output mesh file");
+            "format of the output mesh file")(
+            "ordering", po::value<std::string>()->default_value("rcm"),
+            "ordering of the local nodes: none, rcm, hilbert, morton or nd")(
+            "partitioner", po::value<std::string>()->default_value("metis"),
+            "partitioning backend: metis, rcb, rib or hilbert")(
+            "element_weights", po::value<std::string>()->default_value(""),
+            "METIS weights per element type, e.g. hex=8,prism=6 (default: "
+            "number of vertices)")(
+            "balance_facets", po::value<bool>()->default_value(false),
+            "also balance the boundary facets of each part")(
+            "cache", po::value<std::string>(),
+            "binary snapshot of the input mesh, reused while the input file "
+            "is unchanged")(
+            "compression", po::value<int>()->default_value(4),
+            "deflate level (0-9) of the HDF5 output, 0 disables compression")(
+            "chunk_size", po::value<int>()->default_value(1024),
+            "chunk size of the HDF5 datasets in KiB")(
+            "quality", po::value<std::string>(),
+            "write the partition quality report (JSON) to this file");
 
         po::positional_options_description p_desc;
         p_desc.add("input", -1);
@@ -59,8 +79,12 @@ private:
 };
 
 inline std::ostream &operator<<(std::ostream &os, const ParameterParser &p) {
-    std::vector<std::string> keys = {"help",     "input",  "input_fmt", "num",
-                                     "periodic", "output", "output_fmt"};
+    std::vector<std::string> keys = {"help",     "input",      "input_fmt",
+                                     "num",      "periodic",   "output",
+                                     "output_fmt", "ordering", "partitioner",
+                                     "element_weights", "balance_facets",
+                                     "cache",
+                                     "compression", "chunk_size", "quality"};
     const auto &vm = p._arg_map;
 
     os << "ARGV[" << p._argc << "]: ";
@@ -76,8 +100,10 @@ inline std::ostream &operator<<(std::ostream &os, const ParameterParser &p) {
         if (found) {
             os << key << "[" << found << "]"
                << ": ";
-            if (key == "num")
+            if (key == "num" or key == "compression" or key == "chunk_size")
                 os << vm[key].as<int>() << "\n";
+            else if (key == "balance_facets")
+                os << vm[key].as<bool>() << "\n";
             else {
                 os << vm[key].as<std::string>() << "\n";
             }
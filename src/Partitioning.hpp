@@ -0,0 +1,407 @@
+#ifndef __PARTITIONING_H__
+#define __PARTITIONING_H__
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <charconv>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ElementSpace.hpp"
+#include "Parallel.hpp"
+#include "Reorder.hpp"
+
+namespace partitioning {
+
+/*
+ * Partitioning backends. METIS minimizes the edge cut of the dual graph;
+ * the geometric ones only look at element centroids and run in near-linear
+ * time at the price of a larger cut.
+ */
+enum class Method { METIS, RCB, RIB, Hilbert };
+
+inline Method method_from_string(const std::string &name) {
+    if (name == "metis") {
+        return Method::METIS;
+    } else if (name == "rcb") {
+        return Method::RCB;
+    } else if (name == "rib") {
+        return Method::RIB;
+    } else if (name == "hilbert") {
+        return Method::Hilbert;
+    }
+    throw std::invalid_argument("unknown partitioner: " + name);
+}
+
+inline std::string to_string(Method method) {
+    switch (method) {
+    case Method::METIS:
+        return "metis";
+    case Method::RCB:
+        return "rcb";
+    case Method::RIB:
+        return "rib";
+    case Method::Hilbert:
+        return "hilbert";
+    }
+    return "";
+}
+
+/*
+ * Quality of a partitioning, see MeshPartitioner::quality(). Two ranks are
+ * neighbors when they share a node; the nodes a rank uses but does not own
+ * are its ghosts.
+ */
+struct Quality {
+    std::size_t num_parts = 0;
+    // edges of the dual graph (elements sharing a facet's worth of nodes)
+    // between elements of different ranks
+    std::size_t edge_cut = 0;
+    // objective reported by METIS for the partitioning, -1 if not METIS
+    long metis_objective = -1;
+    // ghost nodes of all ranks: the node values sent at every exchange
+    std::size_t communication_volume = 0;
+    // largest number of elements of a rank over the average
+    double element_imbalance = 0;
+    // per rank
+    std::vector<std::size_t> elements, owned_nodes, ghost_nodes, neighbors;
+    // entry k: pairs of neighbors sharing [2^k, 2^(k+1)) nodes
+    std::vector<std::size_t> interface_histogram;
+
+    std::string to_json() const {
+        std::ostringstream os;
+        auto list = [&os](const std::vector<std::size_t> &values) {
+            os << "[";
+            for (std::size_t i = 0; i < values.size(); ++i) {
+                os << (i ? ", " : "") << values[i];
+            }
+            os << "]";
+        };
+        os << "{\n  \"num_parts\": " << num_parts
+           << ",\n  \"edge_cut\": " << edge_cut
+           << ",\n  \"metis_objective\": " << metis_objective
+           << ",\n  \"communication_volume\": " << communication_volume
+           << ",\n  \"element_imbalance\": " << element_imbalance
+           << ",\n  \"elements\": ";
+        list(elements);
+        os << ",\n  \"owned_nodes\": ";
+        list(owned_nodes);
+        os << ",\n  \"ghost_nodes\": ";
+        list(ghost_nodes);
+        os << ",\n  \"neighbors\": ";
+        list(neighbors);
+        os << ",\n  \"interface_histogram\": ";
+        list(interface_histogram);
+        os << "\n}\n";
+        return os.str();
+    }
+};
+
+/*
+ * Parses per-type element weights such as "hex=8,prism=6". Type names:
+ * line, tri, quad, tet, hex, prism, pyramid, iga2. Weights are integers
+ * >= 0, 0 keeping the default weight.
+ */
+inline std::vector<std::pair<FiniteElementType, long>>
+element_weights_from_string(const std::string &list) {
+    static const std::pair<const char *, FiniteElementType> names[] = {
+        {"line", FiniteElementType::Line},
+        {"tri", FiniteElementType::Triangle},
+        {"quad", FiniteElementType::Quadrangle},
+        {"tet", FiniteElementType::Tetrahedron},
+        {"hex", FiniteElementType::Hexahedron},
+        {"prism", FiniteElementType::Prism},
+        {"pyramid", FiniteElementType::Pyramid},
+        {"iga2", FiniteElementType::IGA2}};
+    std::vector<std::pair<FiniteElementType, long>> weights;
+    std::size_t begin = 0;
+    while (begin < list.size()) {
+        auto end = std::min(list.find(',', begin), list.size());
+        auto item = list.substr(begin, end - begin);
+        auto equal = item.find('=');
+        auto name = item.substr(0, equal);
+        auto it = std::find_if(std::begin(names), std::end(names),
+                               [&](const auto &n) { return name == n.first; });
+        long weight = -1;
+        if (equal != std::string::npos) {
+            const char *value_end = item.data() + item.size();
+            auto [last, error] =
+                std::from_chars(item.data() + equal + 1, value_end, weight);
+            if (error != std::errc() or last != value_end) {
+                weight = -1;
+            }
+        }
+        if (it == std::end(names) or weight < 0) {
+            throw std::invalid_argument("invalid element weight: " + item);
+        }
+        weights.emplace_back(it->second, weight);
+        begin = end + 1;
+    }
+    return weights;
+}
+
+/*
+ * Recursive bisection of points: every segment with more than one part is
+ * cut orthogonally to a direction at the position that splits its points
+ * in proportion to the parts on either side. The direction is the axis of
+ * largest extent (coordinate bisection) or the principal axis of inertia
+ * (inertial bisection). The segments of one level are cut concurrently and
+ * large segments share the threads for their reductions.
+ *
+ * @tparam T index type
+ */
+template <typename T = std::size_t> struct RecursiveBisection {
+    /*
+     * @param points interleaved coordinates, dim per point
+     */
+    RecursiveBisection(const std::vector<double> &points, int dim,
+                       bool inertial = false, std::size_t num_threads = 1)
+        : _points(&points), _dim(dim), _inertial(inertial),
+          _num_threads(std::max<std::size_t>(1, num_threads)) {
+        assert(1 <= dim and dim <= 3);
+    }
+
+    /*
+     * @return the part of every point
+     */
+    std::vector<T> operator()(std::size_t num_parts) const {
+        const std::size_t n = _points->size() / _dim;
+        std::vector<T> parts(n, 0);
+        std::vector<T> index(n);
+        std::iota(index.begin(), index.end(), static_cast<T>(0));
+        std::vector<double> projection(n);
+
+        std::vector<Segment> segments;
+        if (num_parts > 1 and n > 0) {
+            segments.push_back({0, n, 0, num_parts});
+        }
+        while (not segments.empty()) {
+            std::vector<std::array<Segment, 2>> children(segments.size());
+            auto threads_each =
+                std::max<std::size_t>(1, _num_threads / segments.size());
+            parallel::for_each_dynamic(
+                segments.size(), _num_threads,
+                [&](std::size_t s, std::size_t) {
+                    children[s] = _bisect(segments[s], index, projection,
+                                          parts, threads_each);
+                });
+            std::vector<Segment> next;
+            for (const auto &pair : children) {
+                for (const auto &child : pair) {
+                    if (child.num_parts > 1) {
+                        next.push_back(child);
+                    }
+                }
+            }
+            segments = std::move(next);
+        }
+        return parts;
+    }
+
+private:
+    struct Segment {
+        std::size_t begin, end, first_part, num_parts;
+    };
+
+    // moments of a block of points
+    struct Moments {
+        std::array<double, 3> lower, upper, sum;
+        std::array<double, 9> product;
+        std::size_t count;
+
+        Moments() : sum{}, product{}, count(0) {
+            lower.fill(std::numeric_limits<double>::max());
+            upper.fill(std::numeric_limits<double>::lowest());
+        }
+
+        void merge(const Moments &other) {
+            for (int d = 0; d < 3; ++d) {
+                lower[d] = std::min(lower[d], other.lower[d]);
+                upper[d] = std::max(upper[d], other.upper[d]);
+                sum[d] += other.sum[d];
+            }
+            for (int k = 0; k < 9; ++k) {
+                product[k] += other.product[k];
+            }
+            count += other.count;
+        }
+    };
+
+    // points per block of the reductions; fixed so that the result does not
+    // depend on the number of threads
+    static constexpr std::size_t _block = 4096;
+
+    const double *_point(T i) const { return _points->data() + i * _dim; }
+
+    std::array<Segment, 2> _bisect(const Segment &segment,
+                                   std::vector<T> &index,
+                                   std::vector<double> &projection,
+                                   std::vector<T> &parts,
+                                   std::size_t num_threads) const {
+        const auto size = segment.end - segment.begin;
+        const auto num_blocks = (size + _block - 1) / _block;
+        std::vector<Moments> moments(num_blocks);
+        parallel::for_each_chunk(
+            num_blocks, num_threads,
+            [&](std::size_t block_begin, std::size_t block_end, std::size_t) {
+                for (auto b = block_begin; b < block_end; ++b) {
+                    auto &m = moments[b];
+                    auto end = std::min(segment.end,
+                                        segment.begin + (b + 1) * _block);
+                    for (auto i = segment.begin + b * _block; i < end; ++i) {
+                        const auto *x = _point(index[i]);
+                        for (int d = 0; d < _dim; ++d) {
+                            m.lower[d] = std::min(m.lower[d], x[d]);
+                            m.upper[d] = std::max(m.upper[d], x[d]);
+                            m.sum[d] += x[d];
+                            if (_inertial) {
+                                for (int e = 0; e < _dim; ++e) {
+                                    m.product[d * 3 + e] += x[d] * x[e];
+                                }
+                            }
+                        }
+                        ++m.count;
+                    }
+                }
+            });
+        Moments total;
+        for (const auto &m : moments) {
+            total.merge(m);
+        }
+        auto direction =
+            _inertial ? _principal_axis(total) : _widest_axis(total);
+
+        parallel::for_each_chunk(
+            size, num_threads,
+            [&](std::size_t begin, std::size_t end, std::size_t) {
+                for (auto i = segment.begin + begin; i < segment.begin + end;
+                     ++i) {
+                    const auto *x = _point(index[i]);
+                    double p = 0;
+                    for (int d = 0; d < _dim; ++d) {
+                        p += x[d] * direction[d];
+                    }
+                    projection[index[i]] = p;
+                }
+            });
+
+        const auto left_parts = segment.num_parts / 2;
+        const auto right_parts = segment.num_parts - left_parts;
+        const auto middle = segment.begin +
+                            (size * left_parts + segment.num_parts / 2) /
+                                segment.num_parts;
+        std::nth_element(index.begin() + segment.begin, index.begin() + middle,
+                         index.begin() + segment.end, [&](T a, T b) {
+                             return projection[a] < projection[b] or
+                                    (projection[a] == projection[b] and a < b);
+                         });
+
+        std::array<Segment, 2> children = {
+            Segment{segment.begin, middle, segment.first_part, left_parts},
+            Segment{middle, segment.end, segment.first_part + left_parts,
+                    right_parts}};
+        for (const auto &child : children) {
+            if (child.num_parts == 1) {
+                for (auto i = child.begin; i < child.end; ++i) {
+                    parts[index[i]] = static_cast<T>(child.first_part);
+                }
+            }
+        }
+        return children;
+    }
+
+    std::array<double, 3> _widest_axis(const Moments &m) const {
+        int axis = 0;
+        for (int d = 1; d < _dim; ++d) {
+            if (m.upper[d] - m.lower[d] > m.upper[axis] - m.lower[axis]) {
+                axis = d;
+            }
+        }
+        std::array<double, 3> direction = {0, 0, 0};
+        direction[axis] = 1;
+        return direction;
+    }
+
+    /*
+     * Eigenvector of the largest eigenvalue of the covariance matrix, by
+     * power iteration from the axis of largest variance
+     */
+    std::array<double, 3> _principal_axis(const Moments &m) const {
+        std::array<double, 9> covariance = {};
+        std::array<double, 3> mean = {0, 0, 0};
+        for (int d = 0; d < _dim; ++d) {
+            mean[d] = m.sum[d] / m.count;
+        }
+        int axis = 0;
+        for (int d = 0; d < _dim; ++d) {
+            for (int e = 0; e < _dim; ++e) {
+                covariance[d * 3 + e] =
+                    m.product[d * 3 + e] / m.count - mean[d] * mean[e];
+            }
+            if (covariance[d * 3 + d] > covariance[axis * 3 + axis]) {
+                axis = d;
+            }
+        }
+        std::array<double, 3> v = {0, 0, 0};
+        v[axis] = 1;
+        for (int iteration = 0; iteration < 64; ++iteration) {
+            std::array<double, 3> w = {0, 0, 0};
+            double norm = 0;
+            for (int d = 0; d < _dim; ++d) {
+                for (int e = 0; e < _dim; ++e) {
+                    w[d] += covariance[d * 3 + e] * v[e];
+                }
+                norm += w[d] * w[d];
+            }
+            norm = std::sqrt(norm);
+            if (not(norm > 0)) {
+                break;
+            }
+            for (int d = 0; d < _dim; ++d) {
+                v[d] = w[d] / norm;
+            }
+        }
+        return v;
+    }
+
+    const std::vector<double> *_points;
+    int _dim;
+    bool _inertial;
+    std::size_t _num_threads;
+};
+
+/*
+ * Points sorted along the Hilbert curve and cut into num_parts contiguous
+ * pieces of (nearly) equal size.
+ *
+ * @tparam T index type
+ */
+template <typename T = std::size_t>
+std::vector<T> hilbert_partition(const std::vector<double> &points, int dim,
+                                 std::size_t num_parts,
+                                 std::size_t num_threads = 1) {
+    using Curve = typename reordering::SpaceFillingCurve<T>::Curve;
+    auto order = reordering::SpaceFillingCurve<T>(points, dim, Curve::Hilbert,
+                                                  num_threads)();
+    std::vector<T> parts(order.size());
+    num_parts = std::max<std::size_t>(1, num_parts);
+    for (std::size_t p = 0; p < num_parts; ++p) {
+        auto begin = parallel::chunk_begin(order.size(), num_parts, p);
+        auto end = parallel::chunk_begin(order.size(), num_parts, p + 1);
+        for (auto k = begin; k < end; ++k) {
+            parts[order[k]] = static_cast<T>(p);
+        }
+    }
+    return parts;
+}
+
+} // namespace partitioning
+
+#endif // __PARTITIONING_H__
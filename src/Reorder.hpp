@@ -1,48 +1,479 @@
 #ifndef __REORDER_H__
 #define __REORDER_H__
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
-#include <boost/config.hpp>
-#include <boost/graph/bandwidth.hpp>
-#include <boost/graph/cuthill_mckee_ordering.hpp>
-#include <boost/graph/properties.hpp>
+#include <metis.h>
 
-#include "GraphConverter.hpp"
+#include "CSRList.hpp"
 
 namespace reordering {
 
+/*
+ * Node ordering strategies. Every strategy returns an inverse permutation:
+ * entry k is the vertex placed at position k.
+ */
+enum class Ordering { Identity, RCM, Hilbert, Morton, NestedDissection };
+
+inline Ordering ordering_from_string(const std::string &name) {
+    if (name == "none" or name == "identity") {
+        return Ordering::Identity;
+    } else if (name == "rcm") {
+        return Ordering::RCM;
+    } else if (name == "hilbert") {
+        return Ordering::Hilbert;
+    } else if (name == "morton") {
+        return Ordering::Morton;
+    } else if (name == "nd") {
+        return Ordering::NestedDissection;
+    }
+    throw std::invalid_argument("unknown node ordering: " + name);
+}
+
+inline std::string to_string(Ordering ordering) {
+    switch (ordering) {
+    case Ordering::Identity:
+        return "none";
+    case Ordering::RCM:
+        return "rcm";
+    case Ordering::Hilbert:
+        return "hilbert";
+    case Ordering::Morton:
+        return "morton";
+    case Ordering::NestedDissection:
+        return "nd";
+    }
+    return "";
+}
+
+/*
+ * Reverse Cuthill-McKee ordering computed directly on a CSR graph.
+ * Each connected component (taken in order of its smallest vertex) starts
+ * from a pseudo-peripheral vertex found by the George-Liu iteration, and the
+ * children of every vertex are visited by ascending degree. The traversal
+ * reproduces boost::cuthill_mckee_ordering on the undirected graph that
+ * boost::add_edge would build from the list, without materializing it.
+ */
 template <typename T = std::size_t> struct BandwidthReduction {
-    typedef boost::adjacency_list<
-        boost::vecS, boost::vecS, boost::undirectedS,
-        boost::property<boost::vertex_color_t, boost::default_color_type,
-                        boost::property<boost::vertex_degree_t, int>>>
-        Graph;
-    typedef boost::graph_traits<Graph>::vertex_descriptor Vertex;
-    typedef boost::graph_traits<Graph>::vertices_size_type size_type;
+    typedef T size_type;
     typedef CSRList<T, T, std::false_type> CustomizedGraph;
-    BandwidthReduction(const CustomizedGraph &undirected_graph) {
-        GraphConverter c(undirected_graph);
-        _undirected_graph = c.template convert<Graph>();
+
+    /*
+     * @param undirected_graph row i lists neighbors of vertex i; an entry j
+     * in row i stands for the undirected edge {i, j}
+     * @param symmetric the rows already hold both directions of every edge
+     * and are sorted, e.g. a nodal adjacency; the list is then used in place
+     * instead of being symmetrized. The list must outlive this object.
+     */
+    BandwidthReduction(const CustomizedGraph &undirected_graph,
+                       bool symmetric = false)
+        : _source(&undirected_graph), _symmetric(symmetric) {
+        if (not _symmetric) {
+            _symmetrize(undirected_graph);
+        }
+    }
+
+    /*
+     * @return inverse permutation: entry k is the vertex placed at position k
+     */
+    std::vector<T> operator()() const {
+        const auto &graph = _graph();
+        const std::size_t num_vertices = graph.size();
+        std::vector<T> order;
+        order.reserve(num_vertices);
+
+        std::vector<bool> visited(num_vertices, false);
+        std::vector<std::size_t> stamp(num_vertices, 0);
+        std::vector<T> queue;
+        std::size_t generation = 0;
+        for (std::size_t root = 0; root < num_vertices; ++root) {
+            if (visited[root]) {
+                continue;
+            }
+            auto start = _find_starting_node(static_cast<T>(root), stamp,
+                                             generation, queue);
+            _cuthill_mckee(start, visited, order);
+        }
+        assert(order.size() == num_vertices);
+        std::reverse(order.begin(), order.end());
+        return order;
+    }
+
+private:
+    const CustomizedGraph &_graph() const {
+        return _symmetric ? *_source : _symmetrized;
+    }
+
+    std::size_t _degree(T v) const {
+        const auto &offset = _graph().offset();
+        return offset[v + 1] - offset[v];
+    }
+
+    /*
+     * Adjacency lists in the order boost::add_edge appends to them: entry
+     * (i, j) adds j to i and i to j, so a self-loop counts twice.
+     */
+    void _symmetrize(const CustomizedGraph &graph) {
+        const auto &data = graph.data();
+        const auto &offset = graph.offset();
+        std::size_t num_vertices = graph.size();
+        if (not data.empty()) {
+            num_vertices = std::max<std::size_t>(
+                num_vertices, *std::max_element(data.begin(), data.end()) + 1);
+        }
+
+        auto &sym_offset = _symmetrized.offset();
+        sym_offset.assign(num_vertices + 1, 0);
+        for (std::size_t i = 0; i < graph.size(); ++i) {
+            for (auto k = offset[i]; k < offset[i + 1]; ++k) {
+                ++sym_offset[i + 1];
+                ++sym_offset[data[k] + 1];
+            }
+        }
+        std::partial_sum(sym_offset.begin(), sym_offset.end(),
+                         sym_offset.begin());
+
+        auto &sym_data = _symmetrized.data();
+        sym_data.resize(sym_offset.back());
+        std::vector<std::size_t> cursor(sym_offset.begin(),
+                                        sym_offset.end() - 1);
+        for (std::size_t i = 0; i < graph.size(); ++i) {
+            for (auto k = offset[i]; k < offset[i + 1]; ++k) {
+                auto j = data[k];
+                sym_data[cursor[i]++] = j;
+                sym_data[cursor[j]++] = static_cast<T>(i);
+            }
+        }
+    }
+
+    /*
+     * Breadth-first search from root.
+     * @return the number of levels and the vertex of minimal degree in the
+     * last level (the first one on ties)
+     */
+    std::pair<std::size_t, T>
+    _pseudo_peripheral_pair(T root, std::vector<std::size_t> &stamp,
+                            std::size_t &generation,
+                            std::vector<T> &queue) const {
+        const auto &graph = _graph();
+        ++generation;
+        queue.clear();
+        queue.push_back(root);
+        stamp[root] = generation;
+        std::size_t num_levels = 0;
+        T spouse = root;
+        for (std::size_t level_begin = 0; level_begin < queue.size();) {
+            auto level_end = queue.size();
+            spouse = queue[level_begin];
+            for (auto k = level_begin; k < level_end; ++k) {
+                auto u = queue[k];
+                if (_degree(u) < _degree(spouse)) {
+                    spouse = u;
+                }
+                for (auto v : graph[u]) {
+                    if (stamp[v] != generation) {
+                        stamp[v] = generation;
+                        queue.push_back(v);
+                    }
+                }
+            }
+            level_begin = level_end;
+            ++num_levels;
+        }
+        return {num_levels, spouse};
+    }
+
+    T _find_starting_node(T r, std::vector<std::size_t> &stamp,
+                          std::size_t &generation,
+                          std::vector<T> &queue) const {
+        auto [eccen_r, x] =
+            _pseudo_peripheral_pair(r, stamp, generation, queue);
+        auto [eccen_x, y] =
+            _pseudo_peripheral_pair(x, stamp, generation, queue);
+        while (eccen_x > eccen_r) {
+            eccen_r = eccen_x;
+            x = y;
+            std::tie(eccen_x, y) =
+                _pseudo_peripheral_pair(x, stamp, generation, queue);
+        }
+        return x;
+    }
+
+    /*
+     * Appends the component of start to order, visiting the unvisited
+     * neighbors of each vertex by ascending degree.
+     */
+    void _cuthill_mckee(T start, std::vector<bool> &visited,
+                        std::vector<T> &order) const {
+        const auto &graph = _graph();
+        auto by_degree = [this](T a, T b) { return _degree(a) < _degree(b); };
+        visited[start] = true;
+        order.push_back(start);
+        for (auto head = order.size() - 1; head < order.size(); ++head) {
+            auto children_begin = order.size();
+            for (auto v : graph[order[head]]) {
+                if (not visited[v]) {
+                    visited[v] = true;
+                    order.push_back(v);
+                }
+            }
+            std::sort(order.begin() + children_begin, order.end(), by_degree);
+        }
+    }
+
+    const CustomizedGraph *_source;
+    bool _symmetric;
+    CustomizedGraph _symmetrized;
+};
+
+template <typename T = std::size_t> struct Identity {
+    explicit Identity(std::size_t num_vertices) : _num_vertices(num_vertices) {}
+
+    std::vector<T> operator()() const {
+        std::vector<T> order(_num_vertices);
+        std::iota(order.begin(), order.end(), static_cast<T>(0));
+        return order;
     }
 
-    std::vector<T> operator()() {
+private:
+    std::size_t _num_vertices;
+};
+
+/*
+ * Orders vertices along a Hilbert or Morton (Z-order) curve through their
+ * coordinates, quantized on the bounding box to 64 / dim bits per axis
+ * (at most 32). Vertices with the same key keep their relative order.
+ */
+template <typename T = std::size_t> struct SpaceFillingCurve {
+    enum class Curve { Hilbert, Morton };
+
+    /*
+     * @param coordinates interleaved coordinates, dim per vertex
+     * @param num_threads threads computing the keys
+     */
+    SpaceFillingCurve(const std::vector<double> &coordinates, int dim,
+                      Curve curve = Curve::Hilbert, std::size_t num_threads = 1)
+        : _coordinates(&coordinates), _dim(dim), _curve(curve),
+          _num_threads(num_threads) {
+        assert(1 <= dim and dim <= 3);
+    }
+
+    std::vector<T> operator()() const {
+        const auto &x = *_coordinates;
+        const std::size_t num_vertices = x.size() / _dim;
+        const int bits = std::min(32, 64 / _dim);
 
-        auto &G = _undirected_graph;
-        std::vector<Vertex> inv_perm(num_vertices(G));
+        std::array<double, 3> lower, scale;
+        for (int d = 0; d < _dim; ++d) {
+            lower[d] = std::numeric_limits<double>::max();
+            double upper = std::numeric_limits<double>::lowest();
+            for (std::size_t i = 0; i < num_vertices; ++i) {
+                lower[d] = std::min(lower[d], x[i * _dim + d]);
+                upper = std::max(upper, x[i * _dim + d]);
+            }
+            auto extent = upper - lower[d];
+            scale[d] = extent > 0 ? std::ldexp(1.0, bits) / extent : 0.0;
+        }
 
-        boost::cuthill_mckee_ordering(G, inv_perm.rbegin(),
-                                      boost::get(boost::vertex_color, G),
-                                      boost::make_degree_map(G));
-        return std::vector<T>(inv_perm.begin(), inv_perm.end());
+        const auto max_cell = static_cast<double>((1ull << bits) - 1);
+        std::vector<std::pair<std::uint64_t, T>> keys(num_vertices);
+        parallel::for_each_chunk(
+            num_vertices, _num_threads,
+            [&](std::size_t begin, std::size_t end, std::size_t) {
+                std::array<std::uint32_t, 3> cell;
+                for (std::size_t i = begin; i < end; ++i) {
+                    for (int d = 0; d < _dim; ++d) {
+                        auto c = (x[i * _dim + d] - lower[d]) * scale[d];
+                        cell[d] =
+                            static_cast<std::uint32_t>(std::min(c, max_cell));
+                    }
+                    if (_curve == Curve::Hilbert) {
+                        _hilbert_transpose(cell, bits);
+                    }
+                    keys[i] = {_interleave(cell, bits), static_cast<T>(i)};
+                }
+            });
+        std::sort(keys.begin(), keys.end());
+
+        std::vector<T> order(num_vertices);
+        for (std::size_t i = 0; i < num_vertices; ++i) {
+            order[i] = keys[i].second;
+        }
+        return order;
     }
 
 private:
-    Graph _undirected_graph;
+    /*
+     * Converts cell coordinates in place into the transposed Hilbert index
+     * (J. Skilling, "Programming the Hilbert curve", 2004).
+     */
+    void _hilbert_transpose(std::array<std::uint32_t, 3> &cell,
+                            int bits) const {
+        const std::uint32_t top = 1u << (bits - 1);
+        for (std::uint32_t q = top; q > 1; q >>= 1) {
+            const std::uint32_t p = q - 1;
+            for (int d = 0; d < _dim; ++d) {
+                if (cell[d] & q) {
+                    cell[0] ^= p;
+                } else {
+                    auto t = (cell[0] ^ cell[d]) & p;
+                    cell[0] ^= t;
+                    cell[d] ^= t;
+                }
+            }
+        }
+        // Gray encode
+        for (int d = 1; d < _dim; ++d) {
+            cell[d] ^= cell[d - 1];
+        }
+        std::uint32_t t = 0;
+        for (std::uint32_t q = top; q > 1; q >>= 1) {
+            if (cell[_dim - 1] & q) {
+                t ^= q - 1;
+            }
+        }
+        for (int d = 0; d < _dim; ++d) {
+            cell[d] ^= t;
+        }
+    }
+
+    std::uint64_t _interleave(const std::array<std::uint32_t, 3> &cell,
+                              int bits) const {
+        std::uint64_t key = 0;
+        for (int b = bits - 1; b >= 0; --b) {
+            for (int d = 0; d < _dim; ++d) {
+                key = (key << 1) | ((cell[d] >> b) & 1u);
+            }
+        }
+        return key;
+    }
+
+    const std::vector<double> *_coordinates;
+    int _dim;
+    Curve _curve;
+    std::size_t _num_threads;
 };
 
+/*
+ * Fill-reducing nested dissection ordering from METIS_NodeND. Self-loops of
+ * the graph are dropped; the rows must hold both directions of every edge.
+ */
+template <typename T = std::size_t> struct NestedDissection {
+    typedef CSRList<T, T, std::false_type> CustomizedGraph;
+
+    explicit NestedDissection(const CustomizedGraph &undirected_graph)
+        : _graph(&undirected_graph) {}
+
+    std::vector<T> operator()() const {
+        const auto &graph = *_graph;
+        idx_t num_vertices = graph.size();
+        if (num_vertices == 0) {
+            return {};
+        }
+        std::vector<idx_t> xadj(num_vertices + 1, 0);
+        std::vector<idx_t> adjncy;
+        adjncy.reserve(graph.data().size());
+        for (idx_t i = 0; i < num_vertices; ++i) {
+            for (auto j : graph[i]) {
+                if (static_cast<idx_t>(j) != i) {
+                    adjncy.push_back(j);
+                }
+            }
+            xadj[i + 1] = adjncy.size();
+        }
+
+        idx_t options[METIS_NOPTIONS];
+        METIS_SetDefaultOptions(options);
+        options[METIS_OPTION_NUMBERING] = 0;
+        std::vector<idx_t> perm(num_vertices), iperm(num_vertices);
+        auto status =
+            METIS_NodeND(&num_vertices, xadj.data(), adjncy.data(), nullptr,
+                         options, perm.data(), iperm.data());
+        assert(status == METIS_OK);
+        return std::vector<T>(perm.begin(), perm.end());
+    }
+
+private:
+    const CustomizedGraph *_graph;
+};
+
+/*
+ * @param graph symmetric nodal adjacency with sorted rows
+ * @param coordinates interleaved vertex coordinates, dim per vertex; only
+ * used by the space-filling curves
+ */
+template <typename T>
+std::vector<T> make_ordering(Ordering ordering,
+                             const CSRList<T, T, std::false_type> &graph,
+                             const std::vector<double> &coordinates, int dim) {
+    using Curve = typename SpaceFillingCurve<T>::Curve;
+    switch (ordering) {
+    case Ordering::Identity:
+        return Identity<T>(graph.size())();
+    case Ordering::RCM:
+        return BandwidthReduction<T>(graph, true)();
+    case Ordering::Hilbert:
+        return SpaceFillingCurve<T>(coordinates, dim, Curve::Hilbert)();
+    case Ordering::Morton:
+        return SpaceFillingCurve<T>(coordinates, dim, Curve::Morton)();
+    case Ordering::NestedDissection:
+        return NestedDissection<T>(graph)();
+    }
+    return Identity<T>(graph.size())();
+}
+
+struct OrderingMetrics {
+    // max |p(i) - p(j)| over all edges {i, j}
+    std::size_t bandwidth = 0;
+    // sum over rows of the distance from the diagonal to the first nonzero
+    std::size_t profile = 0;
+};
+
+/*
+ * Bandwidth and profile of the adjacency matrix after the vertices are
+ * renumbered by an inverse permutation (entry k is the vertex at position k).
+ */
+template <typename T>
+OrderingMetrics metrics(const CSRList<T, T, std::false_type> &graph,
+                        const std::vector<T> &inverse_permutation) {
+    assert(inverse_permutation.size() == graph.size());
+    std::vector<T> position(inverse_permutation.size());
+    for (std::size_t k = 0; k < inverse_permutation.size(); ++k) {
+        position[inverse_permutation[k]] = static_cast<T>(k);
+    }
+
+    OrderingMetrics results;
+    for (std::size_t k = 0; k < inverse_permutation.size(); ++k) {
+        std::size_t first = k;
+        for (auto j : graph[inverse_permutation[k]]) {
+            std::size_t p = position[j];
+            results.bandwidth = std::max(results.bandwidth,
+                                         p > k ? p - k : k - p);
+            first = std::min(first, p);
+        }
+        results.profile += k - first;
+    }
+    return results;
+}
+
+inline std::ostream &operator<<(std::ostream &os,
+                                const OrderingMetrics &metrics) {
+    return os << "bandwidth: " << metrics.bandwidth
+              << ", profile: " << metrics.profile;
+}
+
 } // namespace reordering
 
-#endif // __REORDER_H__
\ No newline at end of file
+#endif // __REORDER_H__
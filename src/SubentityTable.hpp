@@ -0,0 +1,92 @@
+#ifndef __SUBENTITY_TABLE_H__
+#define __SUBENTITY_TABLE_H__
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+/*
+ * Flat open-addressing hash table that numbers mesh subentities (edges,
+ * faces) by their vertex set. Keys are the sorted vertex tuples padded to N
+ * entries, stored inline in one array together with the entity index, so
+ * lookups touch a single cache line and no node is ever allocated.
+ *
+ * @tparam I index type of vertices and entities
+ * @tparam N maximal number of vertices of a subentity
+ */
+template <typename I, std::size_t N = 4> class SubentityTable {
+public:
+    using Key = std::array<I, N>;
+
+    static constexpr I invalid = std::numeric_limits<I>::max();
+
+    /*
+     * @param max_entities upper bound of the number of distinct keys that
+     * will be inserted; the capacity is the next power of two above it
+     */
+    explicit SubentityTable(std::size_t max_entities) : _size(0) {
+        std::size_t capacity = 16;
+        while (capacity <= max_entities) {
+            capacity <<= 1;
+        }
+        _mask = capacity - 1;
+        _keys.resize(capacity);
+        _values.assign(capacity, invalid);
+    }
+
+    /*
+     * Looks up the entity with the given vertices (in any order) and inserts
+     * it with index `value` if it is not present yet.
+     * @return the entity index and whether it was inserted
+     */
+    template <typename Vertices>
+    std::pair<I, bool> insert(const Vertices &vertices, I value) {
+        auto key = _make_key(vertices);
+        for (auto slot = _hash(key) & _mask;; slot = (slot + 1) & _mask) {
+            if (_values[slot] == invalid) {
+                assert(_size < _values.size() - 1);
+                _keys[slot] = key;
+                _values[slot] = value;
+                ++_size;
+                return {value, true};
+            }
+            if (_keys[slot] == key) {
+                return {_values[slot], false};
+            }
+        }
+    }
+
+    std::size_t size() const { return _size; }
+
+private:
+    template <typename Vertices>
+    static Key _make_key(const Vertices &vertices) {
+        assert(vertices.size() <= N);
+        Key key;
+        key.fill(invalid);
+        std::copy(vertices.begin(), vertices.end(), key.begin());
+        std::sort(key.begin(), key.begin() + vertices.size());
+        return key;
+    }
+
+    static std::uint64_t _hash(const Key &key) {
+        std::uint64_t h = 0x9e3779b97f4a7c15ull;
+        for (auto v : key) {
+            h ^= static_cast<std::uint64_t>(v);
+            h *= 0xff51afd7ed558ccdull;
+            h ^= h >> 32;
+        }
+        return h;
+    }
+
+    std::vector<Key> _keys;
+    std::vector<I> _values;
+    std::size_t _mask;
+    std::size_t _size;
+};
+
+#endif // __SUBENTITY_TABLE_H__
@@ -3,16 +3,26 @@
 #include <ctime>
 
 #include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <fstream>
+#include <initializer_list>
 #include <iostream>
+#include <iterator>
+#include <map>
 #include <numeric>
+#include <set>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include "CSRList.hpp"
+#include "Driver.hpp"
 #include "ElementSpace.hpp"
 #include "Mesh.hpp"
 #include "MeshIO.hpp"
+#include "Parallel.hpp"
 #include "ParameterParser.hpp"
 #include <gtest/gtest.h>
 #include <highfive/H5File.hpp>
@@ -122,6 +132,13 @@ TEST(CSRList, reverse) {
               std::accumulate(list3.data().begin(), list3.data().end(), 0));
     EXPECT_EQ(std::accumulate(list1.offset().begin(), list1.offset().end(), 0),
               std::accumulate(list3.offset().begin(), list3.offset().end(), 0));
+
+    // the multithreaded transpose must match the serial one exactly
+    for (std::size_t num_threads : {2, 3, 16}) {
+        auto list4 = list1.reverse(num_threads);
+        EXPECT_EQ(list4.data(), list2.data());
+        EXPECT_EQ(list4.offset(), list2.offset());
+    }
 }
 
 TEST(CSRList, Iterators) {
@@ -142,6 +159,93 @@ TEST(CSRList, Iterators) {
     EXPECT_EQ(n_y, x.size());
 }
 
+TEST(CSRList, View) {
+    std::vector<double> x{0.0, 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0};
+    std::vector<std::size_t> indptr{0, 3, 5, 9};
+    CSRList list(x, indptr);
+
+    // rows are views into the list storage, no copy is made
+    auto row = list[1];
+    EXPECT_EQ(row.size(), 2);
+    EXPECT_EQ(row.data(), list.data().data() + 3);
+    EXPECT_EQ(row[1], 4.0);
+    EXPECT_EQ(list.begin()->data().data(), list.data().data());
+    EXPECT_TRUE(CSRList(x, std::vector<std::size_t>{0, 0, 9})[0].empty());
+
+    double sum = 0.0;
+    for (auto value : list[2]) {
+        sum += value;
+    }
+    EXPECT_EQ(sum, 26.0);
+
+    // owning copy on request
+    auto copy = list[2].to_vector();
+    EXPECT_EQ(copy.size(), 4);
+    EXPECT_NE(copy.data(), list[2].data());
+
+    CSRList<double> list1;
+    list1.push_back(list[0]);
+    list1.push_back(list[2]);
+    EXPECT_EQ(list1.size(), 2);
+    EXPECT_EQ(list1.offset().back(), 7);
+}
+
+TEST(Parallel, pipeline) {
+    std::vector<std::size_t> consumed;
+    parallel::pipeline(
+        100, 3, [](std::size_t i) { return i * i; },
+        [&](std::size_t value) { consumed.push_back(value); });
+    std::sort(consumed.begin(), consumed.end());
+    ASSERT_EQ(consumed.size(), 100);
+    EXPECT_EQ(consumed[99], 99 * 99);
+
+    // an exception in a worker or in the consumer reaches the caller
+    EXPECT_THROW(parallel::pipeline(
+                     100, 3,
+                     [](std::size_t i) {
+                         if (i == 50) {
+                             throw std::runtime_error("produce");
+                         }
+                         return i;
+                     },
+                     [](std::size_t) {}),
+                 std::runtime_error);
+    EXPECT_THROW(parallel::pipeline(
+                     100, 3, [](std::size_t i) { return i; },
+                     [](std::size_t i) {
+                         if (i == 50) {
+                             throw std::runtime_error("consume");
+                         }
+                     }),
+                 std::runtime_error);
+}
+
+TEST(Parallel, exceptions) {
+    // an exception on a worker or on the calling thread (chunk or thread 0)
+    // reaches the caller once every thread is joined
+    for (std::size_t failing : {0, 2}) {
+        std::atomic<std::size_t> done(0);
+        auto chunk_work = [&](std::size_t begin, std::size_t end,
+                              std::size_t chunk) {
+            if (chunk == failing) {
+                throw std::runtime_error("chunk");
+            }
+            done += end - begin;
+        };
+        EXPECT_THROW(parallel::for_each_chunk(100, 4, chunk_work),
+                     std::runtime_error);
+        EXPECT_EQ(done, 75);
+
+        auto item_work = [&](std::size_t i, std::size_t thread) {
+            if (thread == failing or i == 50) {
+                throw std::runtime_error("item");
+            }
+        };
+        EXPECT_THROW(parallel::for_each_dynamic(100, 4, item_work),
+                     std::runtime_error);
+    }
+}
+
 TEST(Reorder, Graph) {
     using size_type = std::size_t;
     std::vector<size_type> data = {3, 5, 2, 4, 6, 9, 3, 4, 5, 8, 6, 6, 7, 7};
@@ -160,6 +264,81 @@ TEST(Reorder, Graph) {
     }
 }
 
+TEST(Reorder, Symmetric) {
+    // 3x3 grid with self-loops, both directions stored
+    CSRList<size_t, size_t, std::false_type> grid;
+    for (std::size_t i = 0; i < 9; ++i) {
+        std::vector<std::size_t> row;
+        for (std::size_t j = 0; j < 9; ++j) {
+            auto dx = static_cast<int>(i % 3) - static_cast<int>(j % 3);
+            auto dy = static_cast<int>(i / 3) - static_cast<int>(j / 3);
+            if (std::abs(dx) + std::abs(dy) <= 1) {
+                row.push_back(j);
+            }
+        }
+        grid.push_back(row);
+    }
+
+    auto symmetric = reordering::BandwidthReduction(grid, true)();
+    auto general = reordering::BandwidthReduction(grid)();
+    EXPECT_EQ(symmetric, general);
+    auto sorted = symmetric;
+    std::sort(sorted.begin(), sorted.end());
+    for (std::size_t i = 0; i < sorted.size(); ++i) {
+        EXPECT_EQ(sorted[i], i);
+    }
+}
+
+TEST(Reorder, strategies) {
+    // 4x4 grid with self-loops and its vertex coordinates
+    CSRList<size_t, size_t, std::false_type> grid;
+    std::vector<double> coordinates;
+    for (std::size_t i = 0; i < 16; ++i) {
+        std::vector<std::size_t> row;
+        for (std::size_t j = 0; j < 16; ++j) {
+            auto dx = static_cast<int>(i % 4) - static_cast<int>(j % 4);
+            auto dy = static_cast<int>(i / 4) - static_cast<int>(j / 4);
+            if (std::abs(dx) + std::abs(dy) <= 1) {
+                row.push_back(j);
+            }
+        }
+        grid.push_back(row);
+        coordinates.push_back(i % 4);
+        coordinates.push_back(i / 4);
+    }
+
+    using reordering::Ordering;
+    auto identity = reordering::metrics(
+        grid, reordering::make_ordering(Ordering::Identity, grid,
+                                        coordinates, 2));
+    EXPECT_EQ(identity.bandwidth, 4);
+    EXPECT_EQ(identity.profile, 12 * 4 + 3);
+    for (auto ordering : {Ordering::RCM, Ordering::Hilbert, Ordering::Morton,
+                          Ordering::NestedDissection}) {
+        auto order =
+            reordering::make_ordering(ordering, grid, coordinates, 2);
+        EXPECT_EQ(reordering::ordering_from_string(
+                      reordering::to_string(ordering)),
+                  ordering);
+        auto sorted = order;
+        std::sort(sorted.begin(), sorted.end());
+        for (std::size_t i = 0; i < sorted.size(); ++i) {
+            EXPECT_EQ(sorted[i], i);
+        }
+    }
+    auto rcm = reordering::metrics(
+        grid, reordering::make_ordering(Ordering::RCM, grid, coordinates, 2));
+    EXPECT_LE(rcm.bandwidth, identity.bandwidth);
+
+    // the Hilbert curve visits grid neighbors consecutively
+    auto hilbert = reordering::make_ordering(Ordering::Hilbert, grid,
+                                             coordinates, 2);
+    for (std::size_t k = 1; k < hilbert.size(); ++k) {
+        auto row = grid[hilbert[k - 1]];
+        EXPECT_TRUE(std::binary_search(row.begin(), row.end(), hilbert[k]));
+    }
+}
+
 #define BOX_MSH
 #ifdef BOX_MSH
 const std::string filename = "../box.msh";
@@ -208,6 +387,415 @@ TEST(MeshIO, Mesh) {
         EXPECT_EQ(elem.second.size(), element_num[i]);
         ++i;
     }
+
+    // the chunked parser does not depend on the number of threads
+    Mesh<3> serial;
+    serial.set_num_threads(1);
+    MeshIO::read(serial, filename);
+    EXPECT_EQ(serial.nodes(), mesh.nodes());
+    EXPECT_EQ(serial.elements().first.data(), mesh.elements().first.data());
+    EXPECT_EQ(serial.elements().first.offset(),
+              mesh.elements().first.offset());
+    EXPECT_EQ(serial.elements().second, mesh.elements().second);
+    EXPECT_EQ(serial.type_offset(), mesh.type_offset());
+}
+
+TEST(MeshIO, gmsh22) {
+    // two tetrahedra sharing a face, a point element (type 15, skipped), a
+    // second order line (type 8, skipped) and a boundary triangle, with a
+    // $PhysicalNames section before $Nodes
+    const std::string path = "gmsh22.msh";
+    {
+        std::ofstream file(path);
+        file << "$MeshFormat\n2.2 0 8\n$EndMeshFormat\n"
+             << "$PhysicalNames\n1\n3 7 \"volume\"\n$EndPhysicalNames\n"
+             << "$Nodes\n5\n1 0 0 0\n2 1 0 0\n3 0 1 0\n4 0 0 1\n"
+             << "5 1 1 1\n$EndNodes\n"
+             << "$Elements\n5\n1 15 2 0 1 1\n2 4 2 7 1 1 2 3 4\n"
+             << "3 2 2 5 2 1 2 3\n4 8 2 3 3 1 2 5\n"
+             << "5 4 2 7 1 2 3 4 5\n$EndElements\n";
+    }
+    Mesh<3> mesh;
+    EXPECT_EQ(MeshIO::read(mesh, path), 1);
+    EXPECT_EQ(mesh.nodes().size(), 15);
+    EXPECT_EQ(mesh.nodes()[14], 1.0);
+
+    auto [vertices, vertex_ids] = mesh.elements(FiniteElementType::Vertex);
+    EXPECT_EQ(vertices.size(), 5);
+    auto [triangles, triangle_ids] =
+        mesh.elements(FiniteElementType::Triangle);
+    ASSERT_EQ(triangles.size(), 1);
+    EXPECT_EQ(triangles[0].to_vector(), std::vector<std::size_t>({0, 1, 2}));
+    EXPECT_EQ(triangle_ids[0], 5);
+    auto [tets, tet_ids] = mesh.elements(FiniteElementType::Tetrahedron);
+    ASSERT_EQ(tets.size(), 2);
+    EXPECT_EQ(tets[1].to_vector(), std::vector<std::size_t>({1, 2, 3, 4}));
+    EXPECT_EQ(tet_ids, std::vector<std::size_t>({7, 7}));
+    EXPECT_EQ(mesh.elements(FiniteElementType::IGA2).first.size(), 0);
+
+    Mesh<3> ansa;
+    MeshIO::read(ansa, path, MeshIO::MshGenerator::ANSA);
+    EXPECT_EQ(ansa.elements(FiniteElementType::Triangle).second[0], 2);
+
+    // the same mesh in binary, one element group per line of the ASCII file
+    const std::string binary_path = "gmsh22_binary.msh";
+    {
+        std::ofstream file(binary_path, std::ios::binary);
+        auto put_ints = [&](std::initializer_list<std::int32_t> values) {
+            for (std::int32_t v : values) {
+                file.write(reinterpret_cast<const char *>(&v), sizeof(v));
+            }
+        };
+        file << "$MeshFormat\n2.2 1 8\n";
+        put_ints({1});
+        file << "\n$EndMeshFormat\n$Nodes\n5\n";
+        const double x[5][3] = {
+            {0, 0, 0}, {1, 0, 0}, {0, 1, 0}, {0, 0, 1}, {1, 1, 1}};
+        for (std::int32_t i = 0; i < 5; ++i) {
+            put_ints({i + 1});
+            file.write(reinterpret_cast<const char *>(x[i]), sizeof(x[i]));
+        }
+        file << "\n$EndNodes\n$Elements\n5\n";
+        put_ints({15, 1, 2, 1, 0, 1, 1});
+        put_ints({4, 1, 2, 2, 7, 1, 1, 2, 3, 4});
+        put_ints({2, 1, 2, 3, 5, 2, 1, 2, 3});
+        put_ints({8, 1, 2, 4, 3, 3, 1, 2, 5});
+        put_ints({4, 1, 2, 5, 7, 1, 2, 3, 4, 5});
+        file << "\n$EndElements\n";
+    }
+    Mesh<3> binary;
+    EXPECT_EQ(MeshIO::read(binary, binary_path), 1);
+    EXPECT_EQ(binary.nodes(), mesh.nodes());
+    EXPECT_EQ(binary.type_offset(), mesh.type_offset());
+    EXPECT_EQ(binary.elements().first.data(), mesh.elements().first.data());
+    EXPECT_EQ(binary.elements().second, mesh.elements().second);
+    std::remove(binary_path.c_str());
+
+    // a token that is not a number fails the read
+    for (auto bad : {"2 1 x 0\n", "99999999999999999999 1 0 0\n"}) {
+        {
+            std::ofstream file(path);
+            file << "$MeshFormat\n2.2 0 8\n$EndMeshFormat\n"
+                 << "$Nodes\n2\n1 0 0 0\n" << bad << "$EndNodes\n"
+                 << "$Elements\n0\n$EndElements\n";
+        }
+        Mesh<3> malformed;
+        EXPECT_EQ(MeshIO::read(malformed, path), -1);
+        MeshIO::Slice<3, std::size_t> slice;
+        EXPECT_EQ(MeshIO::read_slice(slice, path, 0, 1), -1);
+    }
+    {
+        std::ofstream file(path);
+        file << "$MeshFormat\n2.2 0 8\n$EndMeshFormat\n"
+             << "$Nodes\n4\n1 0 0 0\n2 1 0 0\n3 0 1 0\n4 0 0 1\n"
+             << "$EndNodes\n$Elements\n1\n1 4 2 7 1 1 2 3 x\n$EndElements\n";
+    }
+    Mesh<3> malformed;
+    EXPECT_EQ(MeshIO::read(malformed, path), -1);
+    MeshIO::Slice<3, std::size_t> slice;
+    EXPECT_EQ(MeshIO::read_slice(slice, path, 0, 1), -1);
+    std::remove(path.c_str());
+}
+
+TEST(MeshIO, gmsh41) {
+    // the mesh of MeshIO.gmsh22 with sparse node tags in two entity blocks
+    const std::string path = "gmsh41.msh";
+    {
+        std::ofstream file(path);
+        file << "$MeshFormat\n4.1 0 8\n$EndMeshFormat\n"
+             << "$Entities\n1 0 1 1\n1 0 0 0 0\n5 0 0 0 1 1 0 1 5 0\n"
+             << "1 0 0 0 1 1 1 1 7 0\n$EndEntities\n"
+             << "$Nodes\n2 5 10 50\n2 5 0 3\n10\n20\n30\n0 0 0\n1 0 0\n"
+             << "0 1 0\n3 1 0 2\n40\n50\n0 0 1\n1 1 1\n$EndNodes\n"
+             << "$Elements\n3 4 1 4\n0 1 15 1\n1 10\n2 5 2 1\n3 10 20 30\n"
+             << "3 1 4 2\n2 10 20 30 40\n4 20 30 40 50\n$EndElements\n";
+    }
+    // the same mesh in binary, written with the byte order of the host
+    const std::string binary_path = "gmsh41_binary.msh";
+    {
+        std::ofstream file(binary_path, std::ios::binary);
+        auto put_int = [&](std::int32_t v) {
+            file.write(reinterpret_cast<const char *>(&v), sizeof(v));
+        };
+        auto put_size = [&](std::uint64_t v) {
+            file.write(reinterpret_cast<const char *>(&v), sizeof(v));
+        };
+        auto put_double = [&](double v) {
+            file.write(reinterpret_cast<const char *>(&v), sizeof(v));
+        };
+        file << "$MeshFormat\n4.1 1 8\n";
+        put_int(1);
+        file << "\n$EndMeshFormat\n$Entities\n";
+        for (auto n : {1, 0, 1, 1}) {
+            put_size(n);
+        }
+        put_int(1);
+        for (auto x : {0, 0, 0}) {
+            put_double(x);
+        }
+        put_size(0);
+        for (auto [tag, physical] : {std::pair{5, 5}, std::pair{1, 7}}) {
+            put_int(tag);
+            for (auto x : {0, 0, 0, 1, 1, 1}) {
+                put_double(x);
+            }
+            put_size(1);
+            put_int(physical);
+            put_size(0);
+        }
+        file << "\n$EndEntities\n$Nodes\n";
+        for (auto n : {2, 5, 10, 50}) {
+            put_size(n);
+        }
+        for (auto [dim, tag, nodes] :
+             {std::tuple{2, 5, std::vector<int>{10, 20, 30}},
+              std::tuple{3, 1, std::vector<int>{40, 50}}}) {
+            put_int(dim);
+            put_int(tag);
+            put_int(0);
+            put_size(nodes.size());
+            for (auto node : nodes) {
+                put_size(node);
+            }
+            for (auto node : nodes) {
+                double x[5][3] = {
+                    {0, 0, 0}, {1, 0, 0}, {0, 1, 0}, {0, 0, 1}, {1, 1, 1}};
+                for (auto c : x[node / 10 - 1]) {
+                    put_double(c);
+                }
+            }
+        }
+        file << "\n$EndNodes\n$Elements\n";
+        for (auto n : {3, 4, 1, 4}) {
+            put_size(n);
+        }
+        for (auto [dim, tag, type, elements] :
+             {std::tuple{0, 1, 15, std::vector<int>{1, 10}},
+              std::tuple{2, 5, 2, std::vector<int>{3, 10, 20, 30}},
+              std::tuple{3, 1, 4,
+                         std::vector<int>{2, 10, 20, 30, 40, 4, 20, 30, 40,
+                                          50}}}) {
+            put_int(dim);
+            put_int(tag);
+            put_int(type);
+            put_size(elements.size() / (type == 15 ? 2 : type == 2 ? 4 : 5));
+            for (auto v : elements) {
+                put_size(v);
+            }
+        }
+        file << "\n$EndElements\n";
+    }
+
+    for (const auto &file : {path, binary_path}) {
+        Mesh<3> mesh;
+        ASSERT_EQ(MeshIO::read(mesh, file), 1);
+        EXPECT_EQ(mesh.nodes(), std::vector<double>({0, 0, 0, 1, 0, 0, 0, 1,
+                                                     0, 0, 0, 1, 1, 1, 1}));
+        EXPECT_EQ(mesh.elements(FiniteElementType::Vertex).first.size(), 5);
+        auto [triangles, triangle_ids] =
+            mesh.elements(FiniteElementType::Triangle);
+        ASSERT_EQ(triangles.size(), 1);
+        EXPECT_EQ(triangles[0].to_vector(),
+                  std::vector<std::size_t>({0, 1, 2}));
+        EXPECT_EQ(triangle_ids[0], 5);
+        auto [tets, tet_ids] = mesh.elements(FiniteElementType::Tetrahedron);
+        ASSERT_EQ(tets.size(), 2);
+        EXPECT_EQ(tets[1].to_vector(), std::vector<std::size_t>({1, 2, 3, 4}));
+        EXPECT_EQ(tet_ids, std::vector<std::size_t>({7, 7}));
+
+        Mesh<3> ansa;
+        MeshIO::read(ansa, file, MeshIO::MshGenerator::ANSA);
+        EXPECT_EQ(ansa.elements(FiniteElementType::Tetrahedron).second,
+                  std::vector<std::size_t>({1, 1}));
+        std::remove(file.c_str());
+    }
+
+    // an entity dimension outside 0-3 or a node tag that no $Nodes block
+    // defines fails the read
+    for (auto [block, status] :
+         {std::pair{"3 1 4 2\n1 1 2 3 6\n2 6 3 2 1\n", 1},
+          std::pair{"7 1 4 2\n1 1 2 3 6\n2 6 3 2 1\n", -1},
+          std::pair{"-1 1 4 2\n1 1 2 3 6\n2 6 3 2 1\n", -1},
+          std::pair{"3 1 4 2\n1 1 2 3 6\n2 5 3 2 1\n", -1},
+          std::pair{"3 1 4 2\n1 1 2 3 6\n2 7 3 2 1\n", -1}}) {
+        {
+            std::ofstream file(path);
+            file << "$MeshFormat\n4.1 0 8\n$EndMeshFormat\n"
+                 << "$Nodes\n1 4 1 6\n3 1 0 4\n1\n2\n3\n6\n0 0 0\n"
+                 << "1 0 0\n0 1 0\n0 0 1\n$EndNodes\n"
+                 << "$Elements\n1 2 1 2\n" << block << "$EndElements\n";
+        }
+        Mesh<3> mesh;
+        EXPECT_EQ(MeshIO::read(mesh, path), status);
+    }
+    std::remove(path.c_str());
+}
+
+TEST(MeshIO, cache) {
+    const std::string path = "cache.msh";
+    const std::string cache_path = "cache.mcache";
+    auto write_mesh = [&](int id) {
+        std::ofstream file(path);
+        file << "$MeshFormat\n2.2 0 8\n$EndMeshFormat\n"
+             << "$Nodes\n5\n1 0 0 0\n2 1 0 0\n3 0 1 0\n4 0 0 1\n"
+             << "5 1 1 1\n$EndNodes\n"
+             << "$Elements\n3\n1 4 2 " << id << " 1 1 2 3 4\n"
+             << "2 2 2 5 2 1 2 3\n3 4 2 7 1 2 3 4 5\n$EndElements\n";
+    };
+    write_mesh(7);
+    std::remove(cache_path.c_str());
+
+    Mesh<3> mesh;
+    EXPECT_EQ(MeshIO::read(mesh, path, cache_path), 1);
+    MeshCache<3> snapshot(cache_path);
+    ASSERT_TRUE(snapshot.good());
+    EXPECT_TRUE(snapshot.is_fresh(path));
+    EXPECT_FALSE(snapshot.has_connectivity(2, 3));
+    EXPECT_EQ(snapshot.elements().size(), mesh.elements().first.size());
+    EXPECT_EQ(snapshot.elements()[7].to_vector(),
+              std::vector<std::size_t>({1, 2, 3, 4}));
+    EXPECT_FALSE((MeshCache<3, std::uint32_t>(cache_path).good()));
+
+    Mesh<3> cached;
+    EXPECT_EQ(MeshIO::read(cached, path, cache_path), 2);
+    EXPECT_EQ(cached.nodes(), mesh.nodes());
+    EXPECT_EQ(cached.type_offset(), mesh.type_offset());
+    EXPECT_EQ(cached.elements().first.data(), mesh.elements().first.data());
+    EXPECT_EQ(cached.elements().second, mesh.elements().second);
+
+    // built connectivity is stored and adopted as built
+    mesh.init();
+    MeshIO::write_cache(mesh, cache_path, mesh_cache::hash_file(path));
+    Mesh<3> connected;
+    EXPECT_EQ(MeshIO::read(connected, path, cache_path), 2);
+    EXPECT_TRUE(connected.is_built(2, 3));
+    EXPECT_TRUE(connected.is_adjacency_built());
+    EXPECT_EQ(connected.connectivity(2, 3).data(),
+              mesh.connectivity(2, 3).data());
+    EXPECT_EQ(connected.adjacent_vertices().data(),
+              mesh.adjacent_vertices().data());
+
+    // the caller's subentity generation is kept, and the connectivity of a
+    // snapshot taken with the other setting is built again
+    Mesh<3> generated;
+    generated.enable_subentity_generation();
+    EXPECT_EQ(MeshIO::read(generated, path, cache_path), 2);
+    EXPECT_TRUE(generated.subentity_generation());
+    EXPECT_FALSE(generated.is_built(2, 3));
+    EXPECT_EQ(generated.connectivity(2, 3).size(), 7);
+    EXPECT_EQ(mesh.connectivity(2, 3).size(), 1);
+
+    // element IDs read for another generator are not served from the
+    // snapshot: the elementary tag instead of the physical one
+    Mesh<3> ansa;
+    EXPECT_EQ(MeshIO::read(ansa, path, cache_path,
+                           MeshIO::MshGenerator::ANSA),
+              1);
+    EXPECT_EQ(ansa.elements(FiniteElementType::Tetrahedron).second[0], 1);
+    EXPECT_FALSE(MeshCache<3>(cache_path).is_fresh(path));
+    EXPECT_EQ(MeshIO::read(ansa, path, cache_path,
+                           MeshIO::MshGenerator::ANSA),
+              2);
+    EXPECT_EQ(ansa.elements(FiniteElementType::Tetrahedron).second[0], 1);
+
+    // a modified source invalidates the snapshot
+    write_mesh(8);
+    Mesh<3> updated;
+    EXPECT_EQ(MeshIO::read(updated, path, cache_path), 1);
+    EXPECT_EQ(updated.elements(FiniteElementType::Tetrahedron).second[0], 8);
+    EXPECT_EQ(MeshIO::read(updated, path, cache_path), 2);
+
+    // an edit that keeps the size of the file, e.g. one coordinate
+    {
+        std::string text;
+        {
+            std::ifstream file(path);
+            text.assign(std::istreambuf_iterator<char>(file), {});
+        }
+        text.replace(text.find("5 1 1 1"), 7, "5 1 1 2");
+        std::ofstream(path) << text;
+    }
+    Mesh<3> edited;
+    EXPECT_EQ(MeshIO::read(edited, path, cache_path), 1);
+    EXPECT_EQ(edited.nodes()[14], 2.0);
+    std::remove(cache_path.c_str());
+
+    // the top bit of two words flipped together, a common pattern in
+    // binary files, changes the hash
+    {
+        std::string bytes(32, '\0');
+        std::ofstream(path, std::ios::binary) << bytes;
+        auto before = mesh_cache::hash_file(path);
+        bytes[7] = bytes[15] = static_cast<char>(0x80);
+        std::ofstream(path, std::ios::binary) << bytes;
+        EXPECT_NE(mesh_cache::hash_file(path), before);
+    }
+    std::remove(path.c_str());
+}
+
+TEST(MeshIO, slice) {
+    // the slices of all parts put together give the mesh read at once
+    Mesh<3> mesh;
+    MeshIO::read(mesh, filename);
+    const std::size_t num_parts = 3;
+    std::vector<double> nodes;
+    std::vector<CSRList<std::size_t>> elements(
+        ElementSpace<3>::all_element_types().size());
+    std::vector<std::vector<std::size_t>> element_ID(elements.size());
+    for (std::size_t part = 0; part < num_parts; ++part) {
+        MeshIO::Slice<3, std::size_t> slice;
+        ASSERT_EQ(MeshIO::read_slice(slice, filename, part, num_parts), 1);
+        EXPECT_EQ(slice.first_node, nodes.size() / 3);
+        nodes.insert(nodes.end(), slice.nodes.begin(), slice.nodes.end());
+        for (std::size_t t = 0, row = 0; t < elements.size(); ++t) {
+            for (std::size_t k = 0; k < slice.type_count[t]; ++k, ++row) {
+                elements[t].push_back(slice.elements[row].to_vector());
+                element_ID[t].push_back(slice.element_ID[row]);
+            }
+        }
+    }
+    EXPECT_EQ(nodes, mesh.nodes());
+    EXPECT_EQ(elements[static_cast<std::size_t>(FiniteElementType::Triangle)]
+                  .size(),
+              0);
+    for (auto type : ElementSpace<3>::prime_element_types()) {
+        auto t = static_cast<std::size_t>(type);
+        auto [expected, expected_ID] = mesh.elements(type);
+        EXPECT_EQ(elements[t].data(), expected.data());
+        EXPECT_EQ(element_ID[t], expected_ID);
+    }
+
+    // a second order line (type 8) is not read as an IGA2 element
+    const std::string line_path = "slice22.msh";
+    {
+        std::ofstream file(line_path);
+        file << "$MeshFormat\n2.2 0 8\n$EndMeshFormat\n"
+             << "$Nodes\n5\n1 0 0 0\n2 1 0 0\n3 0 1 0\n4 0 0 1\n"
+             << "5 1 1 1\n$EndNodes\n"
+             << "$Elements\n3\n1 4 2 7 1 1 2 3 4\n2 8 2 3 3 1 2 5\n"
+             << "3 4 2 7 1 2 3 4 5\n$EndElements\n";
+    }
+    {
+        MeshIO::Slice<3, std::size_t> slice;
+        ASSERT_EQ(MeshIO::read_slice(slice, line_path, 0, 1), 1);
+        EXPECT_EQ(slice.type_count[static_cast<std::size_t>(
+                      FiniteElementType::IGA2)],
+                  0);
+        ASSERT_EQ(slice.elements.size(), 2);
+        EXPECT_EQ(slice.elements[1].to_vector(),
+                  std::vector<std::size_t>({1, 2, 3, 4}));
+    }
+    std::remove(line_path.c_str());
+
+    // only Gmsh 2.2 ASCII files can be sliced
+    const std::string path = "slice41.msh";
+    {
+        std::ofstream file(path);
+        file << "$MeshFormat\n4.1 0 8\n$EndMeshFormat\n";
+    }
+    MeshIO::Slice<3, std::size_t> slice;
+    EXPECT_EQ(MeshIO::read_slice(slice, path, 0, 1), -1);
+    std::remove(path.c_str());
 }
 
 TEST(MeshConnectivity, Mesh) {
@@ -355,6 +943,105 @@ TEST(MeshConnectivity, Mesh) {
     }
 }
 
+TEST(MeshConnectivity, subentities) {
+    Mesh<3> mesh;
+    MeshIO::read(mesh, filename);
+    const auto file_facets = mesh.elements(2).first;
+    mesh.init(true);
+
+    const auto &cells = mesh.element_collections(3);
+    const auto &facets = mesh.element_collections(2);
+    const auto &edges = mesh.element_collections(1);
+    const auto &map3to2 = mesh.connectivity(3, 2);
+    const auto &map2to3 = mesh.connectivity(2, 3);
+    const auto &map3to1 = mesh.connectivity(3, 1);
+    const auto &map1to0 = mesh.connectivity(1, 0);
+    ASSERT_EQ(map3to2.size(), cells.size());
+    ASSERT_EQ(map2to3.size(), facets.size());
+    ASSERT_EQ(map3to1.size(), cells.size());
+    ASSERT_EQ(map1to0.size(), edges.size());
+
+    // facets of the mesh file keep their indices
+    ASSERT_GE(facets.size(), file_facets.size());
+    for (std::size_t i = 0; i < file_facets.size(); ++i) {
+        EXPECT_TRUE(std::equal(file_facets[i].begin(), file_facets[i].end(),
+                               facets[i].begin()));
+    }
+
+    std::size_t num_boundary_facets = 0;
+    for (std::size_t i = 0; i < map2to3.size(); ++i) {
+        ASSERT_GE(map2to3[i].size(), 1);
+        ASSERT_LE(map2to3[i].size(), 2);
+        num_boundary_facets += map2to3[i].size() == 1;
+    }
+    EXPECT_EQ(num_boundary_facets, element_num[2]);
+    for (std::size_t i = 0; i < map3to2.size(); ++i) {
+        EXPECT_EQ(map3to2[i].size(), 4);
+        EXPECT_EQ(map3to1[i].size(), 6);
+        for (auto iedge : map3to1[i]) {
+            for (auto ivtx : map1to0[iedge]) {
+                EXPECT_NE(std::find(cells[i].begin(), cells[i].end(), ivtx),
+                          cells[i].end());
+            }
+        }
+    }
+
+    // Euler characteristic of a tetrahedralized ball
+    long euler = static_cast<long>(mesh.nodes().size() / 3) -
+                 static_cast<long>(edges.size()) +
+                 static_cast<long>(facets.size()) -
+                 static_cast<long>(cells.size());
+    EXPECT_EQ(euler, 1);
+    EXPECT_EQ(mesh.orientation().size(), facets.size());
+}
+
+TEST(MeshConnectivity, lazy) {
+    Mesh<3> eager;
+    MeshIO::read(eager, filename);
+    eager.init(true);
+    Mesh<3> mesh;
+    MeshIO::read(mesh, filename);
+    mesh.enable_subentity_generation();
+    mesh.set_num_threads(3);
+
+    EXPECT_FALSE(mesh.is_built(2, 3));
+    const auto &map2to3 = mesh.connectivity(2, 3);
+    EXPECT_TRUE(mesh.is_built(2, 3));
+    EXPECT_TRUE(mesh.is_built(3, 2));
+    EXPECT_FALSE(mesh.is_built(3, 1));
+    EXPECT_EQ(map2to3.data(), eager.connectivity(2, 3).data());
+    EXPECT_EQ(map2to3.offset(), eager.connectivity(2, 3).offset());
+
+    auto mask = mesh.built_mask();
+    EXPECT_TRUE(mask[2 * 4 + 3]);
+    EXPECT_FALSE(mask[3 * 4 + 1]);
+    auto footprint = mesh.memory_footprint();
+    EXPECT_GE(mesh.memory_footprint(2, 3),
+              map2to3.data().size() * sizeof(std::size_t));
+    mesh.release(2, 3);
+    EXPECT_FALSE(mesh.is_built(2, 3));
+    EXPECT_EQ(mesh.memory_footprint(2, 3), 0);
+    EXPECT_LT(mesh.memory_footprint(), footprint);
+    EXPECT_EQ(mesh.orientation().data(), eager.orientation().data());
+    EXPECT_EQ(mesh.connectivity(1, 3).data(), eager.connectivity(1, 3).data());
+    EXPECT_EQ(mesh.adjacent_vertices().data(),
+              eager.adjacent_vertices().data());
+
+    // generated pairs keep the local subentity order when rebuilt
+    for (std::size_t dim : {2, 1}) {
+        mesh.connectivity(3, dim);
+        mesh.release(3, dim);
+        EXPECT_FALSE(mesh.is_built(3, dim));
+        EXPECT_EQ(mesh.connectivity(3, dim).data(),
+                  eager.connectivity(3, dim).data());
+    }
+
+    mesh.release();
+    EXPECT_TRUE(mesh.built_mask().none());
+    EXPECT_EQ(mesh.element_collections(1).size(),
+              eager.element_collections(1).size());
+}
+
 TEST(MeshPartitioner, partitioning) {
     Mesh<3> mesh;
     MeshIO::read(mesh, filename);
@@ -385,12 +1072,310 @@ TEST(MeshPartitioner, partitioning) {
                 EXPECT_EQ(ghosted[j], is_ghosted);
             }
             EXPECT_EQ(element.size(), part.part(i, "e").size());
+            for (std::size_t j = 0; j < element.size(); ++j) {
+                EXPECT_EQ(part.element_rank()[element[j]], i);
+                EXPECT_EQ(part.element_local_index()[element[j]], j);
+            }
+            for (auto n : local_nodes) {
+                EXPECT_EQ(part.node_rank()[n], i);
+            }
         }
     }
 
+    // all partitions at once on 3 threads
+    mesh.set_num_threads(3);
+    auto all = part.local_mesh_data_all();
+    ASSERT_EQ(all.size(), num_parts);
+    for (int i = 0; i < num_parts; ++i) {
+        EXPECT_EQ(all[i], part.local_mesh_data(i));
+    }
+
     MeshIO::write(mesh, "mesh.h5");
 }
 
+TEST(MeshPartitioner, geometric) {
+    Mesh<3> mesh;
+    MeshIO::read(mesh, filename);
+    EXPECT_THROW(partitioning::method_from_string("scotch"),
+                 std::invalid_argument);
+    for (auto name : {"rcb", "rib", "hilbert"}) {
+        auto method = partitioning::method_from_string(name);
+        EXPECT_EQ(partitioning::to_string(method), name);
+        mesh.set_num_threads(1);
+        mesh.partition(6, method);
+        auto serial = mesh.element_rank();
+        mesh.set_num_threads(3);
+        mesh.partition(6, method);
+        EXPECT_EQ(mesh.element_rank(), serial);
+
+        ASSERT_EQ(mesh.num_partitions(), 6);
+        std::size_t ne = 0, nn = 0;
+        for (int i = 0; i < 6; ++i) {
+            // equal element counts up to rounding
+            auto size = mesh.part(i, "e").size();
+            EXPECT_LE(size, element_num[4] / 6 + 1);
+            EXPECT_GE(size, element_num[4] / 6);
+            ne += size;
+            nn += mesh.part(i, "n").size();
+            auto [node, ghosted, element] = mesh.local_mesh_data(i);
+            EXPECT_EQ(element.size(), size);
+        }
+        EXPECT_EQ(ne, element_num[4]);
+        EXPECT_EQ(nn, num_entities[0]);
+
+        // zero parts are one part holding everything
+        for (std::size_t num_parts : {0, 1}) {
+            mesh.partition(num_parts, method);
+            ASSERT_EQ(mesh.num_partitions(), 1);
+            EXPECT_EQ(mesh.part(0, "e").size(), element_num[4]);
+            EXPECT_EQ(mesh.part(0, "n").size(), num_entities[0]);
+        }
+    }
+}
+
+TEST(MeshPartitioner, weights) {
+    auto weights = partitioning::element_weights_from_string("hex=8,tet=2");
+    ASSERT_EQ(weights.size(), 2);
+    EXPECT_EQ(weights[0].first, FiniteElementType::Hexahedron);
+    EXPECT_EQ(weights[1].second, 2);
+    for (auto bad : {"cube=1", "hex", "hex=-3", "hex=x", "hex=3x", "hex="}) {
+        EXPECT_THROW(partitioning::element_weights_from_string(bad),
+                     std::invalid_argument);
+    }
+    try {
+        partitioning::element_weights_from_string("tet=1,hex=x");
+        ADD_FAILURE() << "hex=x was accepted";
+    } catch (const std::invalid_argument &e) {
+        EXPECT_EQ(std::string(e.what()), "invalid element weight: hex=x");
+    }
+
+    Mesh<3> mesh;
+    MeshIO::read(mesh, filename);
+    EXPECT_EQ(mesh.element_weight(FiniteElementType::Tetrahedron), 0);
+    for (auto [type, weight] : weights) {
+        mesh.set_element_weight(type, weight);
+    }
+    EXPECT_EQ(mesh.element_weight(FiniteElementType::Tetrahedron), 2);
+
+    // a strip of 24 unit cubes: 12 hexahedra, then 12 cubes of 6 tetrahedra
+    const std::string path = "weights.msh";
+    {
+        auto node = [](int i, int j, int k) { return 4 * i + 2 * j + k + 1; };
+        std::ofstream file(path);
+        file << "$MeshFormat\n2.2 0 8\n$EndMeshFormat\n$Nodes\n100\n";
+        for (int i = 0; i <= 24; ++i) {
+            for (int j = 0; j < 2; ++j) {
+                for (int k = 0; k < 2; ++k) {
+                    file << node(i, j, k) << " " << i << " " << j << " " << k
+                         << "\n";
+                }
+            }
+        }
+        file << "$EndNodes\n$Elements\n84\n";
+        int id = 0;
+        for (int c = 0; c < 12; ++c) {
+            file << ++id << " 5 2 1 1 " << node(c, 0, 0) << " "
+                 << node(c + 1, 0, 0) << " " << node(c + 1, 1, 0) << " "
+                 << node(c, 1, 0) << " " << node(c, 0, 1) << " "
+                 << node(c + 1, 0, 1) << " " << node(c + 1, 1, 1) << " "
+                 << node(c, 1, 1) << "\n";
+        }
+        // Kuhn subdivision along the diagonal of each cube
+        const int paths[6][2][3] = {
+            {{1, 0, 0}, {1, 1, 0}}, {{1, 0, 0}, {1, 0, 1}},
+            {{0, 1, 0}, {1, 1, 0}}, {{0, 1, 0}, {0, 1, 1}},
+            {{0, 0, 1}, {1, 0, 1}}, {{0, 0, 1}, {0, 1, 1}}};
+        for (int c = 12; c < 24; ++c) {
+            for (const auto &p : paths) {
+                file << ++id << " 4 2 1 1 " << node(c, 0, 0) << " "
+                     << node(c + p[0][0], p[0][1], p[0][2]) << " "
+                     << node(c + p[1][0], p[1][1], p[1][2]) << " "
+                     << node(c + 1, 1, 1) << "\n";
+            }
+        }
+        file << "$EndElements\n";
+    }
+    // load of each part when a hexahedron costs six tetrahedra
+    auto hex_load = [](const Mesh<3> &strip) {
+        const auto &elements = strip.element_collections(3);
+        std::vector<std::size_t> load(2, 0);
+        for (std::size_t e = 0; e < elements.size(); ++e) {
+            load[strip.element_rank()[e]] += elements[e].size() == 8 ? 6 : 1;
+        }
+        return load;
+    };
+    Mesh<3> weighted, unweighted;
+    MeshIO::read(weighted, path);
+    MeshIO::read(unweighted, path);
+    std::remove(path.c_str());
+    weighted.set_element_weight(FiniteElementType::Hexahedron, 6);
+    weighted.set_element_weight(FiniteElementType::Tetrahedron, 1);
+    unweighted.set_element_weight(FiniteElementType::Hexahedron, 1);
+    unweighted.set_element_weight(FiniteElementType::Tetrahedron, 1);
+    weighted.metis(2);
+    unweighted.metis(2);
+    // 144 in total: balanced with the weights, not with equal weights
+    auto load = hex_load(weighted);
+    EXPECT_LE(*std::max_element(load.begin(), load.end()), 80);
+    load = hex_load(unweighted);
+    EXPECT_GE(*std::max_element(load.begin(), load.end()), 90);
+    auto sizes = [](const Mesh<3> &strip) {
+        return std::make_pair(strip.part(0, "e").size(),
+                              strip.part(1, "e").size());
+    };
+    EXPECT_NE(sizes(weighted), sizes(unweighted));
+
+    // elements and boundary facets balanced together
+    mesh.balance_boundary_facets();
+    mesh.metis(4);
+    std::size_t ne = 0, nn = 0;
+    for (int i = 0; i < 4; ++i) {
+        ne += mesh.part(i, "e").size();
+        nn += mesh.part(i, "n").size();
+    }
+    EXPECT_EQ(ne, element_num[4]);
+    EXPECT_EQ(nn, num_entities[0]);
+}
+
+TEST(MeshPartitioner, quality) {
+    Mesh<3> mesh;
+    MeshIO::read(mesh, filename);
+    mesh.partition(5, partitioning::Method::RCB);
+    mesh.set_num_threads(1);
+    auto serial = mesh.quality();
+    mesh.set_num_threads(3);
+    auto quality = mesh.quality();
+    EXPECT_EQ(quality.to_json(), serial.to_json());
+    EXPECT_EQ(quality.metis_objective, -1);
+    // the report leaves no connectivity behind, and reuses what is built
+    EXPECT_FALSE(mesh.is_built(0, 3));
+    mesh.connectivity(0, 3);
+    EXPECT_EQ(mesh.quality().to_json(), quality.to_json());
+
+    // brute force: ranks around every node, cut facets
+    const auto &elements = mesh.element_collections(3);
+    const auto &rank = mesh.element_rank();
+    std::vector<std::set<std::size_t>> node_ranks(num_entities[0]);
+    for (std::size_t e = 0; e < elements.size(); ++e) {
+        for (auto v : elements[e]) {
+            node_ranks[v].insert(rank[e]);
+        }
+    }
+    std::vector<std::size_t> ghosts(5, 0);
+    std::map<std::pair<std::size_t, std::size_t>, std::size_t> shared;
+    for (std::size_t v = 0; v < node_ranks.size(); ++v) {
+        for (auto r : node_ranks[v]) {
+            ghosts[r] += mesh.node_rank()[v] != r;
+            for (auto s : node_ranks[v]) {
+                if (r < s) {
+                    ++shared[{r, s}];
+                }
+            }
+        }
+    }
+    std::vector<std::size_t> neighbors(5, 0), histogram;
+    for (auto [pair, size] : shared) {
+        ++neighbors[pair.first];
+        ++neighbors[pair.second];
+        std::size_t bin = std::log2(size);
+        histogram.resize(std::max(histogram.size(), bin + 1), 0);
+        ++histogram[bin];
+    }
+    // tetrahedra sharing a face
+    std::size_t edge_cut = 0;
+    for (std::size_t e = 0; e < elements.size(); ++e) {
+        for (std::size_t f = 0; f < e; ++f) {
+            std::size_t common = 0;
+            for (auto v : elements[e]) {
+                auto w = elements[f];
+                common += std::find(w.begin(), w.end(), v) != w.end();
+            }
+            edge_cut += common >= 3 and rank[e] != rank[f];
+        }
+    }
+    EXPECT_GT(edge_cut, 0);
+    EXPECT_EQ(quality.edge_cut, edge_cut);
+    EXPECT_EQ(quality.ghost_nodes, ghosts);
+    EXPECT_EQ(quality.communication_volume,
+              std::accumulate(ghosts.begin(), ghosts.end(), 0ul));
+    EXPECT_EQ(quality.neighbors, neighbors);
+    EXPECT_EQ(quality.interface_histogram, histogram);
+    EXPECT_EQ(std::accumulate(quality.owned_nodes.begin(),
+                              quality.owned_nodes.end(), 0ul),
+              num_entities[0]);
+    EXPECT_GE(quality.element_imbalance, 1.0);
+    EXPECT_LT(quality.element_imbalance, 1.01);
+    EXPECT_NE(quality.to_json().find("\"edge_cut\": " +
+                                     std::to_string(edge_cut)),
+              std::string::npos);
+
+    // stored with the partitions
+    mesh.metis(4);
+    EXPECT_GE(mesh.quality().metis_objective, 0);
+    MeshIO::write(mesh, "quality.h5");
+    HDF5File file("quality.h5", "r");
+    std::size_t num_parts = 0;
+    std::vector<std::size_t> owned;
+    file.read_attribute(num_parts, "mesh/partition", "num_parts");
+    file.read_attribute(owned, "mesh/partition", "owned_nodes");
+    EXPECT_EQ(num_parts, 4);
+    EXPECT_EQ(owned, mesh.quality().owned_nodes);
+}
+
+TEST(MeshPartitioner, ordering) {
+    Mesh<3> mesh;
+    MeshIO::read(mesh, filename);
+    mesh.metis(4);
+    auto [node, ghosted, element] = mesh.local_mesh_data(0);
+
+    using reordering::Ordering;
+    auto identity = mesh.ordering_metrics(0, Ordering::Identity);
+    auto rcm = mesh.ordering_metrics(0, Ordering::RCM);
+    EXPECT_LT(rcm.bandwidth, identity.bandwidth);
+    for (auto ordering : {Ordering::Identity, Ordering::Hilbert,
+                          Ordering::Morton, Ordering::NestedDissection}) {
+        mesh.set_ordering(ordering);
+        auto [other_node, other_ghosted, other_element] =
+            mesh.local_mesh_data(0);
+        EXPECT_EQ(other_element.size(), element.size());
+        std::sort(other_node.begin(), other_node.end());
+        auto sorted_node = node;
+        std::sort(sorted_node.begin(), sorted_node.end());
+        EXPECT_EQ(other_node, sorted_node);
+    }
+}
+
+TEST(MeshPartitioner, index_type) {
+    Mesh<3> mesh;
+    MeshIO::read(mesh, filename);
+    Mesh<3, std::uint32_t> mesh32;
+    MeshIO::read(mesh32, filename);
+    mesh.init();
+    mesh32.init();
+
+    const auto &conn = mesh.connectivity(3, 2);
+    const auto &conn32 = mesh32.connectivity(3, 2);
+    ASSERT_EQ(conn.data().size(), conn32.data().size());
+    EXPECT_TRUE(std::equal(conn.data().begin(), conn.data().end(),
+                           conn32.data().begin()));
+    // 32-bit indices, but offsets that go past 2^32 vertex references
+    static_assert(
+        std::is_same_v<std::decay_t<decltype(conn32.offset())>::value_type,
+                       std::size_t>);
+    EXPECT_EQ(conn32.offset(), conn.offset());
+
+    auto num_parts = 4;
+    mesh.metis(num_parts);
+    mesh32.metis(num_parts);
+    for (int i = 0; i < num_parts; ++i) {
+        auto element = mesh.part(i, "e");
+        auto element32 = mesh32.part(i, "e");
+        ASSERT_EQ(element.size(), element32.size());
+        EXPECT_TRUE(
+            std::equal(element.begin(), element.end(), element32.begin()));
+    }
+}
+
 TEST(ParameterParser, cli_help) {
     std::vector<std::string> param = {"mp", "--help"};
     int local_argc = param.size();
@@ -477,6 +1462,241 @@ TEST(HDF5File, write) {
     }
 }
 
+TEST(HDF5File, read) {
+    std::vector<double> v_double(16);
+    std::iota(v_double.begin(), v_double.end(), 0.5);
+    auto tuple = std::make_tuple(std::vector<int>({1, 2, 3}), 4, 'c');
+    CSRList<std::size_t> list;
+    list.push_back(std::vector<std::size_t>({0, 1, 2}));
+    list.push_back(std::vector<std::size_t>({3}));
+    {
+        HDF5File f("stl_read.h5", "w");
+        f.write(v_double, "Adouble");
+        f.write(tuple, "Atuple");
+        f.write(list, "Acsrlist");
+    }
+    HDF5File f("stl_read.h5", "r");
+    std::vector<double> v;
+    f.read(v, "Adouble");
+    EXPECT_EQ(v, v_double);
+    decltype(tuple) t;
+    f.read(t, "Atuple");
+    EXPECT_EQ(t, tuple);
+    CSRList<std::size_t> l;
+    f.read(l, "Acsrlist");
+    EXPECT_EQ(l.data(), list.data());
+    EXPECT_EQ(l.offset(), list.offset());
+    EXPECT_TRUE(f.exist("Acsrlist"));
+    EXPECT_FALSE(f.exist("Amissing"));
+}
+
+TEST(HDF5File, compression) {
+    std::vector<std::size_t> large(100000), empty;
+    std::iota(large.begin(), large.end(), 0);
+    HDF5File::StorageOptions storage;
+    storage.chunk_bytes = 1 << 12;
+    {
+        HDF5File f("compressed.h5", "w", storage);
+        f.write(large, "large");
+        f.write(empty, "empty");
+        f.write(std::size_t(7), "scalar");
+    }
+    HDF5File f("compressed.h5", "r");
+    std::vector<std::size_t> v(1);
+    f.read(v, "large");
+    EXPECT_EQ(v, large);
+    f.read(v, "empty");
+    EXPECT_TRUE(v.empty());
+    std::size_t scalar = 0;
+    f.read(scalar, "scalar");
+    EXPECT_EQ(scalar, 7);
+}
+
+TEST(MeshIO, h5) {
+    Mesh<3> mesh;
+    MeshIO::read(mesh, filename);
+
+    // an unpartitioned mesh has no partition group
+    {
+        mesh.init();
+        EXPECT_EQ(MeshIO::write(mesh, "mesh_unpartitioned.h5"), 1);
+        EXPECT_FALSE(
+            HDF5File("mesh_unpartitioned.h5", "r").exist("mesh/partition"));
+        Mesh<3> loaded;
+        EXPECT_EQ(MeshIO::read(loaded, "mesh_unpartitioned.h5"), 1);
+        EXPECT_EQ(loaded.nodes(), mesh.nodes());
+        EXPECT_EQ(loaded.elements(3).first.data(),
+                  mesh.elements(3).first.data());
+        EXPECT_EQ(loaded.num_partitions(), 0);
+    }
+
+    mesh.metis(4);
+    // partitions are exported by a pool of 3 threads
+    mesh.set_num_threads(3);
+    EXPECT_EQ(MeshIO::write(mesh, "mesh_read.h5"), 1);
+
+    Mesh<3> loaded;
+    EXPECT_EQ(MeshIO::read(loaded, "mesh_read.h5"), 1);
+    EXPECT_TRUE(loaded.is_adjacency_built());
+    EXPECT_EQ(loaded.nodes(), mesh.nodes());
+    EXPECT_EQ(loaded.elements(2).first.data(), mesh.elements(2).first.data());
+    EXPECT_EQ(loaded.elements(3).first.data(), mesh.elements(3).first.data());
+    EXPECT_EQ(loaded.elements(3).second, mesh.elements(3).second);
+    EXPECT_EQ(loaded.type_offset(FiniteElementType::Tetrahedron).second -
+                  loaded.type_offset(FiniteElementType::Tetrahedron).first,
+              element_num[4]);
+    ASSERT_EQ(loaded.num_partitions(), 4);
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_EQ(loaded.part(i, "e"), mesh.part(i, "e"));
+        EXPECT_EQ(loaded.part(i, "n"), mesh.part(i, "n"));
+        EXPECT_EQ(loaded.local_mesh_data(i), mesh.local_mesh_data(i));
+    }
+
+    // facets attached to the local elements of each rank
+    HDF5File file("mesh_read.h5", "r");
+    const auto &conn = mesh.connectivity(2, 3);
+    const auto &orientation = mesh.orientation();
+    for (int i = 0; i < 4; ++i) {
+        auto element = mesh.part(i, "e");
+        std::vector<std::size_t> id, attach, orient;
+        std::vector<std::size_t> stored_id, stored_attach, stored_orient;
+        for (std::size_t ifacet = 0; ifacet < conn.size(); ++ifacet) {
+            for (std::size_t j = 0; j < conn[ifacet].size(); ++j) {
+                auto it = std::find(element.begin(), element.end(),
+                                    conn[ifacet][j]);
+                if (it != element.end()) {
+                    id.push_back(ifacet);
+                    attach.push_back(std::distance(element.begin(), it));
+                    orient.push_back(orientation[ifacet][j]);
+                }
+            }
+        }
+        auto partpath = "mesh/partition/" + std::to_string(i);
+        file.read(stored_id, partpath + "/facet/id");
+        file.read(stored_attach, partpath + "/facet/e");
+        file.read(stored_orient, partpath + "/facet/o");
+        EXPECT_EQ(stored_id, id);
+        EXPECT_EQ(stored_attach, attach);
+        EXPECT_EQ(stored_orient, orient);
+    }
+
+    // a missing file or dataset fails the read without creating anything
+    Mesh<3> missing;
+    EXPECT_EQ(MeshIO::read(missing, "mesh_missing.h5"), -1);
+    EXPECT_FALSE(std::ifstream("mesh_missing.h5"));
+    {
+        HDF5File incomplete("mesh_incomplete.h5", "w");
+        incomplete.write(mesh.nodes(), "mesh/node");
+    }
+    EXPECT_EQ(MeshIO::read(missing, "mesh_incomplete.h5"), -1);
+}
+
+TEST(Driver, run) {
+    const std::string path = "driver.msh";
+    {
+        std::ofstream file(path);
+        file << "$MeshFormat\n2.2 0 8\n$EndMeshFormat\n"
+             << "$Nodes\n5\n1 0 0 0\n2 1 0 0\n3 0 1 0\n4 0 0 1\n"
+             << "5 1 1 1\n$EndNodes\n"
+             << "$Elements\n2\n1 4 2 7 1 1 2 3 4\n"
+             << "2 4 2 7 1 2 3 4 5\n$EndElements\n";
+    }
+    std::vector<std::string> param = {"mp", "-i", path, "-n", "2",
+                                      "--ordering", "none", "-o",
+                                      "driver.h5"};
+    std::vector<const char *> argv_array;
+    for (const auto &p : param) {
+        argv_array.push_back(p.c_str());
+    }
+    ParameterParser cli(argv_array.size(), argv_array.data());
+    Mesh<3> mesh;
+    EXPECT_EQ(driver::read(mesh, cli), 1);
+    EXPECT_EQ(driver::partition(mesh, cli), 1);
+    EXPECT_EQ(mesh.num_partitions(), 2);
+    EXPECT_EQ(mesh.ordering(), reordering::Ordering::Identity);
+    EXPECT_GE(mesh.quality().metis_objective, 0);
+    EXPECT_EQ(driver::write(mesh, cli), 1);
+    EXPECT_EQ(driver::report(mesh, cli), 1);
+    EXPECT_EQ(driver::run(cli), 0);
+    auto storage = driver::storage_options(cli);
+    EXPECT_EQ(storage.deflate, 4);
+    EXPECT_EQ(storage.chunk_bytes, 1 << 20);
+    {
+        std::vector<const char *> storage_argv = {"mp", "--compression", "0",
+                                                  "--chunk_size", "64"};
+        ParameterParser storage_cli(storage_argv.size(), storage_argv.data());
+        storage = driver::storage_options(storage_cli);
+        EXPECT_EQ(storage.deflate, 0);
+        EXPECT_EQ(storage.chunk_bytes, 64 << 10);
+        storage_argv[2] = "10";
+        EXPECT_THROW(driver::storage_options(ParameterParser(
+                         storage_argv.size(), storage_argv.data())),
+                     std::invalid_argument);
+    }
+
+    // through a snapshot of the mesh
+    param.insert(param.end(), {"--cache", "driver.mcache"});
+    argv_array.clear();
+    for (const auto &p : param) {
+        argv_array.push_back(p.c_str());
+    }
+    ParameterParser cached_cli(argv_array.size(), argv_array.data());
+    std::remove("driver.mcache");
+    Mesh<3> first, cached;
+    EXPECT_EQ(driver::read(first, cached_cli), 1);
+    EXPECT_EQ(driver::read(cached, cached_cli), 2);
+    EXPECT_EQ(cached.nodes(), mesh.nodes());
+
+    // METIS weights
+    EXPECT_EQ(mesh.element_weight(FiniteElementType::Tetrahedron), 0);
+    EXPECT_FALSE(mesh.boundary_facets_balanced());
+    {
+        std::vector<const char *> weight_argv = {
+            "mp", "-n", "2", "--element_weights", "tet=3,hex=8",
+            "--balance_facets", "1"};
+        ParameterParser weight_cli(weight_argv.size(), weight_argv.data());
+        Mesh<3> weighted;
+        EXPECT_EQ(driver::read(weighted, cli), 1);
+        EXPECT_EQ(driver::partition(weighted, weight_cli), 1);
+        EXPECT_EQ(weighted.element_weight(FiniteElementType::Tetrahedron), 3);
+        EXPECT_EQ(weighted.element_weight(FiniteElementType::Hexahedron), 8);
+        EXPECT_TRUE(weighted.boundary_facets_balanced());
+    }
+
+    // a geometric backend
+    {
+        std::vector<const char *> rcb_argv = {"mp", "-n", "2",
+                                              "--partitioner", "rcb"};
+        ParameterParser rcb_cli(rcb_argv.size(), rcb_argv.data());
+        Mesh<3> rcb;
+        EXPECT_EQ(driver::read(rcb, cli), 1);
+        EXPECT_EQ(driver::partition(rcb, rcb_cli), 1);
+        EXPECT_EQ(rcb.num_partitions(), 2);
+        EXPECT_EQ(rcb.quality().metis_objective, -1);
+    }
+
+    // the quality report
+    {
+        std::vector<const char *> quality_argv = {
+            "mp", path.c_str(), "-n", "2", "--quality", "driver.json"};
+        ParameterParser quality_cli(quality_argv.size(), quality_argv.data());
+        EXPECT_EQ(driver::run(quality_cli), 0);
+        std::ifstream file("driver.json");
+        std::string json(std::istreambuf_iterator<char>(file), {});
+        EXPECT_EQ(json, mesh.quality().to_json());
+        std::remove("driver.json");
+    }
+
+    // option values that cannot be parsed fail the run
+    argv_array[6] = "unknown";
+    EXPECT_EQ(driver::run(ParameterParser(argv_array.size(),
+                                          argv_array.data())),
+              1);
+    std::remove("driver.mcache");
+    std::remove("driver.h5");
+    std::remove(path.c_str());
+}
+
 int main(int argc, char *argv[]) {
     testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -0,0 +1,87 @@
+#ifndef USE_PARMETIS
+#error "the distributed partitioner needs ParMETIS, build with make mp_mpi"
+#endif
+
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <string>
+
+#include <mpi.h>
+
+#include "DistributedPartitioner.hpp"
+#include "Driver.hpp"
+#include "ParameterParser.hpp"
+#include "Reorder.hpp"
+
+/*
+ * Distributed partitioning of a Gmsh 2.2 ASCII mesh into one part per rank:
+ *
+ *   mpirun -np 4 ./mp_mpi -i ../box.msh -o box
+ *
+ * writes box.0.h5, ..., box.3.h5. Before exiting, the partitions are
+ * checked: every prime element is on exactly one rank and every node of a
+ * partition is owned by exactly one rank.
+ */
+static int run(int argc, char *argv[]) {
+    ParameterParser cli(argc, argv);
+    DistributedPartitioner<3> partitioner(MPI_COMM_WORLD);
+    const bool root = partitioner.rank() == 0;
+    if (not cli.has("input")) {
+        if (root) {
+            std::cerr << "No input mesh, see --help" << std::endl;
+        }
+        return 1;
+    }
+    if (partitioner.read(cli.eval<std::string>("input")) < 0 or
+        partitioner.partition() < 0 or partitioner.redistribute() < 0) {
+        return 1;
+    }
+    partitioner.local_mesh().set_ordering(
+        reordering::ordering_from_string(cli.eval<std::string>("ordering")));
+
+    auto [node, is_ghosted, element] = partitioner.partition_data();
+    std::int64_t count[3] = {static_cast<std::int64_t>(element.size()), 0, 0};
+    for (auto ghosted : is_ghosted) {
+        ++count[ghosted ? 2 : 1];
+    }
+    std::int64_t total[3];
+    MPI_Allreduce(count, total, 3, MPI_INT64_T, MPI_SUM, MPI_COMM_WORLD);
+    int status = total[0] == static_cast<std::int64_t>(
+                                 partitioner.num_global_elements()) and
+                         total[1] == static_cast<std::int64_t>(
+                                         partitioner.num_global_nodes())
+                     ? 0
+                     : 1;
+    std::cout << "rank " << partitioner.rank() << ": " << count[0]
+              << " elements, " << count[1] << " owned and " << count[2]
+              << " ghost nodes" << std::endl;
+    if (root) {
+        std::cout << "edge cut: " << partitioner.edgecut() << ", "
+                  << total[0] << " elements, " << total[1] << " nodes"
+                  << (status ? " (inconsistent)" : "") << std::endl;
+    }
+
+    if (cli.has("output")) {
+        int written = partitioner.write(cli.eval<std::string>("output"),
+                                        driver::storage_options(cli));
+        MPI_Allreduce(MPI_IN_PLACE, &written, 1, MPI_INT, MPI_MIN,
+                      MPI_COMM_WORLD);
+        if (written < 0) {
+            status = 1;
+        }
+    }
+    return status;
+}
+
+int main(int argc, char *argv[]) {
+    MPI_Init(&argc, &argv);
+    int status = 1;
+    try {
+        status = run(argc, argv);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+    }
+    MPI_Finalize();
+    return status;
+}
@@ -0,0 +1,14 @@
+#include "Driver.hpp"
+#include "ParameterParser.hpp"
+
+/*
+ * Partitioning of a mesh on one process:
+ *
+ *   ./mp_serial -i ../box.msh -n 4 -o box.h5
+ *
+ * writes the four partitions of box.msh to box.h5, see driver::run().
+ */
+int main(int argc, char *argv[]) {
+    ParameterParser cli(argc, argv);
+    return driver::run(cli);
+}